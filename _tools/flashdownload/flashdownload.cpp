@@ -0,0 +1,240 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+/*
+ * Downloads the camera FLASH, or part of it, to a file.
+ *
+ * flashdownload <device> <file> [offset [size]]
+ *
+ * Examples:
+ * ./flashdownload /dev/ttyACM0 flash.bin
+ * ./flashdownload /dev/ttyACM0 recording.bin 0x100000
+ *
+ * The file holds size bytes starting at FLASH address offset, by default the
+ * whole 8MByte FLASH. If the file already exists, the download resumes after
+ * the data it contains. Chunks are checked with the packet CRC, and after an
+ * error the download is restarted from the first missing chunk.
+ */
+
+#include "../../drivers/usb_protocol.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+
+using namespace std;
+using namespace std::chrono;
+
+static const unsigned int flashSize = 8 * 1024 * 1024;
+static const int maxRetries = 10;
+
+static void setTTYRawAttr(int fd)
+{
+    struct termios tty;
+    tcgetattr(fd, &tty);
+    cfmakeraw(&tty);
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cc[VTIME] = 0;
+    tty.c_cc[VMIN] = 1;
+    tcsetattr(fd, TCSANOW, &tty);
+}
+
+static void writeLine(int fd, const string& line)
+{
+    string s = line + "\n";
+    if (write(fd, s.data(), s.size()) != static_cast<ssize_t>(s.size()))
+        perror("write");
+}
+
+// Read a line, without the line ending. Returns false on timeout
+static bool readLine(int fd, string& line, int timeoutMs)
+{
+    line.clear();
+    for (;;)
+    {
+        pollfd p = { fd, POLLIN, 0 };
+        if (poll(&p, 1, timeoutMs) <= 0) return false;
+        char c;
+        if (read(fd, &c, 1) != 1) return false;
+        if (c == '\n') return true;
+        if (c != '\r') line += c;
+    }
+}
+
+/*
+ * Download from addr to end, writing the data to out at address - offset.
+ * Returns the address of the first byte not downloaded
+ */
+static unsigned int download(int fd, int out, unsigned int offset,
+                             unsigned int addr, unsigned int end)
+{
+    writeLine(fd, "stop_stream");
+    usleep(100 * 1000);
+    tcflush(fd, TCIOFLUSH);
+    writeLine(fd, "download " + to_string(addr) + " " + to_string(end - addr));
+    string reply;
+    // Skip the reply to the empty line, if any
+    while (readLine(fd, reply, 1000) && reply != "binary") ;
+    if (reply != "binary")
+    {
+        fprintf(stderr, "no download, reply \"%s\"\n", reply.c_str());
+        return addr;
+    }
+
+    vector<uint8_t> buffer;
+    bool failed = false; // Once a chunk is lost, wait for the end of the stream
+    for (;;)
+    {
+        pollfd p = { fd, POLLIN, 0 };
+        if (poll(&p, 1, 1000) <= 0)
+        {
+            fprintf(stderr, "timeout @ address 0x%x\n", addr);
+            return addr;
+        }
+        uint8_t data[4096];
+        ssize_t n = read(fd, data, sizeof(data));
+        if (n <= 0) return addr;
+        buffer.insert(buffer.end(), data, data + n);
+
+        // Parse all complete packets in the buffer
+        const uint8_t sync[] = { usbPacketSync & 0xff, usbPacketSync >> 8 };
+        for (;;)
+        {
+            auto it = search(buffer.begin(), buffer.end(), sync, sync + 2);
+            buffer.erase(buffer.begin(), it);
+            if (buffer.size() < sizeof(UsbPacketHeader)) break;
+            UsbPacketHeader header;
+            memcpy(&header, buffer.data(), sizeof(header));
+            if (header.length > usbMaxPayloadSize || header.length < sizeof(uint32_t))
+            {
+                buffer.erase(buffer.begin());
+                continue;
+            }
+            size_t size = sizeof(header) + header.length + usbPacketCrcSize;
+            if (buffer.size() < size) break;
+            uint16_t crc;
+            memcpy(&crc, buffer.data() + size - usbPacketCrcSize, sizeof(crc));
+            if (crc != crc16Update(crc16Init, buffer.data(), size - usbPacketCrcSize))
+            {
+                fprintf(stderr, "bad CRC @ address 0x%x\n", addr);
+                failed = true;
+                buffer.erase(buffer.begin());
+                continue;
+            }
+            if (header.type != static_cast<uint8_t>(UsbPacketType::FlashData))
+            {
+                buffer.erase(buffer.begin(), buffer.begin() + size);
+                continue;
+            }
+            uint32_t chunkAddr;
+            memcpy(&chunkAddr, buffer.data() + sizeof(header), sizeof(chunkAddr));
+            const uint8_t *chunk = buffer.data() + sizeof(header) + sizeof(chunkAddr);
+            int chunkSize = header.length - sizeof(chunkAddr);
+            if (chunkSize == 0)
+            {
+                // Last packet, the device stopped at chunkAddr
+                if (failed == false && chunkAddr != addr)
+                    fprintf(stderr, "device stopped @ address 0x%x\n", chunkAddr);
+                return addr;
+            }
+            if (failed == false && chunkAddr != addr)
+            {
+                fprintf(stderr, "lost chunk @ address 0x%x\n", addr);
+                failed = true;
+            }
+            if (failed == false)
+            {
+                if (pwrite(out, chunk, chunkSize, addr - offset) != chunkSize)
+                {
+                    perror("write");
+                    failed = true;
+                } else addr += chunkSize;
+            }
+            buffer.erase(buffer.begin(), buffer.begin() + size);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: flashdownload <device> <file> [offset [size]]\n");
+        return 1;
+    }
+    unsigned int offset = argc > 3 ? strtoul(argv[3], nullptr, 0) : 0;
+    unsigned int size = argc > 4 ? strtoul(argv[4], nullptr, 0) : flashSize - offset;
+    if (offset > flashSize || size > flashSize - offset)
+    {
+        fprintf(stderr, "range exceeds the FLASH size\n");
+        return 1;
+    }
+
+    int out = open(argv[2], O_WRONLY | O_CREAT, 0644);
+    if (out < 0)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+    // Resume after the data already in the file
+    off_t existing = lseek(out, 0, SEEK_END);
+    unsigned int addr = offset + min<off_t>(max<off_t>(existing, 0), size);
+    if (addr > offset) printf("resuming from address 0x%x\n", addr);
+    const unsigned int end = offset + size;
+
+    int fd = open(argv[1], O_RDWR | O_NOCTTY);
+    if (fd < 0)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    setTTYRawAttr(fd);
+    auto start = steady_clock::now();
+    const unsigned int first = addr;
+    for (int retry = 0; addr < end && retry <= maxRetries; retry++)
+        addr = download(fd, out, offset, addr, end);
+    writeLine(fd, "stop_stream");
+    close(fd);
+    close(out);
+
+    double seconds = duration_cast<duration<double>>(steady_clock::now() - start).count();
+    printf("%u bytes in %.1fs, %.3f MB/s\n", addr - first, seconds,
+           (addr - first) / seconds / 1e6);
+    if (addr < end)
+    {
+        fprintf(stderr, "incomplete, run again to resume\n");
+        return 1;
+    }
+    return 0;
+}
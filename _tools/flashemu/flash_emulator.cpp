@@ -0,0 +1,205 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include <drivers/flash.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+/*
+ * Typical 25Q64 timings from the datasheet, and the SPI clock of the board.
+ * The worst case ones are several times longer
+ */
+static const long long pageProgramTime=700000LL;   //0.7ms
+static const long long sectorEraseTime=45000000LL; //45ms
+static const long long blockEraseTime=150000000LL; //150ms
+static const long long spiByteTime=533LL;          //8 bits at 15MHz
+
+static mt19937 randomGenerator(random_device{}());
+
+//
+// class Flash
+//
+
+Flash& Flash::instance()
+{
+    static Flash singleton;
+    return singleton;
+}
+
+bool Flash::open(const char *path)
+{
+    lock_guard<mutex> l(m);
+    int fd=::open(path,O_RDWR | O_CREAT,0644);
+    if(fd<0)
+    {
+        perror(path);
+        return false;
+    }
+    struct stat st;
+    fstat(fd,&st);
+    //The part of the file that did not exist is erased, not zeroed
+    const off_t oldSize=st.st_size;
+    if(oldSize<static_cast<off_t>(size()) && ftruncate(fd,size())!=0)
+    {
+        perror(path);
+        ::close(fd);
+        return false;
+    }
+    void *p=mmap(nullptr,size(),PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+    ::close(fd);
+    if(p==MAP_FAILED)
+    {
+        perror(path);
+        return false;
+    }
+    mem=static_cast<unsigned char*>(p);
+    if(oldSize<static_cast<off_t>(size())) memset(mem+oldSize,0xff,size()-oldSize);
+    counters.erasesPerSector.assign(size()/sectorSize(),0);
+    return true;
+}
+
+void Flash::eraseSector(unsigned int addr)
+{
+    lock_guard<mutex> l(m);
+    if(mem==nullptr) violation("Erase before open",addr);
+    //Like the hardware, the address can be anywhere in the sector
+    addr&=~(sectorSize()-1);
+    if(addr>=size()) violation("Erase out of range",addr);
+    if(powerLost())
+    {
+        //An interrupted erase leaves a random mix of erased and old bytes
+        for(unsigned int i=0;i<sectorSize();i++)
+            if(randomGenerator() & 1) mem[addr+i]=0xff;
+        _exit(powerLossExitCode);
+    }
+    memset(mem+addr,0xff,sectorSize());
+    counters.sectorErases++;
+    counters.erasesPerSector[addr/sectorSize()]++;
+    busy(sectorEraseTime);
+}
+
+void Flash::eraseBlock(unsigned int addr)
+{
+    lock_guard<mutex> l(m);
+    if(mem==nullptr) violation("Erase before open",addr);
+    addr&=~(blockSize()-1);
+    if(addr>=size()) violation("Erase out of range",addr);
+    if(powerLost())
+    {
+        for(unsigned int i=0;i<blockSize();i++)
+            if(randomGenerator() & 1) mem[addr+i]=0xff;
+        _exit(powerLossExitCode);
+    }
+    memset(mem+addr,0xff,blockSize());
+    counters.blockErases++;
+    for(unsigned int i=0;i<blockSize();i+=sectorSize())
+        counters.erasesPerSector[(addr+i)/sectorSize()]++;
+    busy(blockEraseTime);
+}
+
+bool Flash::write(unsigned int addr, const void *data, int size)
+{
+    if(addr>=this->size() || addr+size>this->size()) return false;
+    lock_guard<mutex> l(m);
+    if(mem==nullptr) violation("Write before open",addr);
+    //The hardware would wrap around to the start of the page
+    if(size<=0 || addr/pageSize()!=(addr+size-1)/pageSize())
+        violation("Write crossing a page boundary",addr);
+    auto *p=static_cast<const unsigned char*>(data);
+    //Programming can only clear bits, setting them needs an erase. This is
+    //allowed by the hardware, but it is a bug as the data is not what the
+    //caller wrote
+    for(int i=0;i<size;i++)
+        if((mem[addr+i] & p[i])!=p[i]) violation("Write to non-erased byte",addr+i);
+    if(powerLost())
+    {
+        //Bytes are programmed in order, the one being programmed gets only
+        //some of its bits cleared
+        int done=uniform_int_distribution<int>(0,size-1)(randomGenerator);
+        for(int i=0;i<done;i++) mem[addr+i]&=p[i];
+        mem[addr+done]&=p[done] | randomGenerator();
+        _exit(powerLossExitCode);
+    }
+    for(int i=0;i<size;i++) mem[addr+i]&=p[i];
+    counters.programs++;
+    counters.bytesProgrammed+=size;
+    busy(pageProgramTime+(4+size)*spiByteTime);
+    return true;
+}
+
+bool Flash::read(unsigned int addr, void *data, int size)
+{
+    if(addr>=this->size() || addr+size>this->size()) return false;
+    lock_guard<mutex> l(m);
+    if(mem==nullptr) violation("Read before open",addr);
+    memcpy(data,mem+addr,size);
+    counters.reads++;
+    counters.bytesRead+=size;
+    busy((4+size)*spiByteTime);
+    return true;
+}
+
+void Flash::setSeed(unsigned int seed)
+{
+    lock_guard<mutex> l(m);
+    randomGenerator.seed(seed);
+}
+
+Flash::Stats Flash::stats()
+{
+    lock_guard<mutex> l(m);
+    return counters;
+}
+
+Flash::Flash() {}
+
+void Flash::busy(long long ns)
+{
+    counters.busyTime+=ns;
+    if(realTime) this_thread::sleep_for(chrono::nanoseconds(ns));
+}
+
+void Flash::violation(const char *what, unsigned int addr)
+{
+    fprintf(stderr,"FLASH emulator: %s @ address 0x%x\n",what,addr);
+    abort();
+}
+
+bool Flash::powerLost()
+{
+    return powerLossCountdown>0 && --powerLossCountdown==0;
+}
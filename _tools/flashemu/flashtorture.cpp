@@ -0,0 +1,205 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+/*
+ * Power loss torture test of the options storage, on the FLASH emulator.
+ *
+ * flashtorture <file> [cycles] [seed]
+ *
+ * Each cycle runs in a child process, like a boot of the device. It loads
+ * the options and checks them, then saves new ones until a power loss is
+ * injected at a random program or erase operation. Two record types of
+ * different size are saved alternately, so compaction is interrupted too.
+ * After a power loss, each type must load either the last value whose save
+ * completed, or the one whose save was interrupted, and never corrupted data.
+ * At the end the options are loaded once more without a power loss.
+ * The power loss points are random, the seed is printed at the start and can
+ * be passed to reproduce a failing run, starting from the same FLASH file.
+ */
+
+#include <drivers/flash.h>
+#include <drivers/options_save.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+/// Options whose content can be checked, up to a page in size
+struct TestOptions
+{
+    unsigned int value;
+    unsigned int check; ///< ~value
+    unsigned char fill[64]; ///< value & 0xff
+};
+
+static const int types=2;
+static const int sizes[types]={ sizeof(TestOptions), 16 };
+
+/// Sent by the child to the parent through a pipe
+struct Message
+{
+    int type;
+    unsigned int value;
+    bool done; ///< false before saving value, true after
+};
+
+static TestOptions make(unsigned int value)
+{
+    TestOptions o;
+    o.value=value;
+    o.check=~value;
+    memset(o.fill,value & 0xff,sizeof(o.fill));
+    return o;
+}
+
+static void send(int fd, int type, unsigned int value, bool done)
+{
+    Message m={ type, value, done };
+    if(write(fd,&m,sizeof(m))!=sizeof(m)) _exit(1);
+}
+
+/**
+ * Child process: check the options, then save until the power loss
+ */
+static void child(const char *path, int fd, int powerLoss, unsigned int seed)
+{
+    if(freopen("/dev/null","w",stdout)==nullptr) _exit(1); //Silence the driver
+    auto& flash=Flash::instance();
+    if(flash.open(path)==false) _exit(1);
+    flash.setSeed(seed);
+    unsigned int values[types];
+    for(int t=0;t<types;t++)
+    {
+        TestOptions o=make(0);
+        loadOptions(t,1,&o,sizeof(o)); //If not found the default is 0
+        if(o.check!=~o.value || memcmp(o.fill,make(o.value).fill,sizes[t]-8)!=0)
+        {
+            fprintf(stderr,"Corrupted options of type %d\n",t);
+            _exit(2);
+        }
+        send(fd,t,o.value,true);
+        values[t]=o.value;
+    }
+    flash.powerLossAfter(powerLoss);
+    for(int i=0;;i++)
+    {
+        int t=i%types;
+        TestOptions o=make(++values[t]);
+        send(fd,t,values[t],false);
+        if(saveOptions(t,1,&o,sizes[t])==false) _exit(1);
+        send(fd,t,values[t],true);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc<2)
+    {
+        fprintf(stderr,"usage: flashtorture <file> [cycles] [seed]\n");
+        return 1;
+    }
+    int cycles=argc>2 ? atoi(argv[2]) : 1000;
+    unsigned int seed=argc>3 ? strtoul(argv[3],nullptr,0) : random_device{}();
+    fprintf(stderr,"seed %u\n",seed);
+    mt19937 rng(seed);
+    unsigned int confirmed[types], pending[types];
+    bool first=true, saving[types]={false,false};
+    long long saves=0;
+    for(int c=0;c<cycles;c++)
+    {
+        int fds[2];
+        if(pipe(fds)!=0) return 1;
+        int powerLoss=uniform_int_distribution<int>(1,40)(rng);
+        unsigned int damageSeed=rng();
+        pid_t pid=fork();
+        if(pid==0)
+        {
+            close(fds[0]);
+            child(argv[1],fds[1],powerLoss,damageSeed);
+        }
+        close(fds[1]);
+        //The first message of each type is the value loaded at boot
+        int loaded=0;
+        Message m;
+        while(read(fds[0],&m,sizeof(m))==sizeof(m))
+        {
+            if(loaded<types)
+            {
+                bool ok=first || m.value==confirmed[m.type]
+                        || (saving[m.type] && m.value==pending[m.type]);
+                if(ok==false)
+                {
+                    fprintf(stderr,"cycle %d: type %d loaded %u, expected %u\n",
+                            c,m.type,m.value,confirmed[m.type]);
+                    return 1;
+                }
+                confirmed[m.type]=m.value;
+                saving[m.type]=false;
+                if(++loaded==types) first=false;
+            } else if(m.done) {
+                confirmed[m.type]=m.value;
+                saving[m.type]=false;
+                saves++;
+            } else {
+                pending[m.type]=m.value;
+                saving[m.type]=true;
+            }
+        }
+        close(fds[0]);
+        int status;
+        waitpid(pid,&status,0);
+        if(!WIFEXITED(status) || WEXITSTATUS(status)!=Flash::powerLossExitCode)
+        {
+            fprintf(stderr,"cycle %d: child failed with status 0x%x\n",c,status);
+            return 1;
+        }
+    }
+
+    //Final check, without a power loss
+    auto& flash=Flash::instance();
+    if(flash.open(argv[1])==false) return 1;
+    freopen("/dev/null","w",stdout);
+    for(int t=0;t<types;t++)
+    {
+        TestOptions o=make(0);
+        if(loadOptions(t,1,&o,sizeof(o))==false || o.check!=~o.value)
+        {
+            fprintf(stderr,"final check failed for type %d\n",t);
+            return 1;
+        }
+    }
+    auto stats=flash.stats();
+    fprintf(stderr,"%d power losses, %lld completed saves, all options consistent\n",
+            cycles,saves);
+    fprintf(stderr,"final scan: %lld reads, %lld bytes, %.1fms simulated\n",
+            stats.reads,stats.bytesRead,stats.busyTime/1e6);
+    return 0;
+}
@@ -0,0 +1,295 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "display_memory.h"
+#include "line.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+//SPI bytes sent by DisplayErOledm015 to open a window (column, row and remap
+//commands, then the write RAM command), and to set the cursor for setPixel()
+static const int windowBytes=10;
+static const int cursorBytes=7;
+
+namespace mxgui {
+
+//
+// class DisplayMemory
+//
+
+const short DisplayMemory::width;
+const short DisplayMemory::height;
+
+DisplayMemory::DisplayMemory() : x0(0), x1(0), y0(0), y1(0), x(0), y(0),
+    direction(RD)
+{
+    fill(fb,fb+width*height,Color(0));
+    setTextColor(make_pair(Color(0xffff),Color(0x0)));
+}
+
+void DisplayMemory::doTurnOn()
+{
+    accumulatedCost.calls++;
+    accumulatedCost.bytes++;
+}
+
+void DisplayMemory::doTurnOff()
+{
+    accumulatedCost.calls++;
+    accumulatedCost.bytes++;
+}
+
+void DisplayMemory::doSetBrightness(int brt)
+{
+    accumulatedCost.calls++;
+    accumulatedCost.bytes+=2;
+}
+
+pair<short int, short int> DisplayMemory::doGetSize() const
+{
+    return make_pair(height,width);
+}
+
+void DisplayMemory::write(Point p, const char *text)
+{
+    accumulatedCost.calls++;
+    font.draw(*this,textColor,p,text);
+}
+
+void DisplayMemory::clippedWrite(Point p, Point a, Point b, const char *text)
+{
+    accumulatedCost.calls++;
+    font.clippedDraw(*this,textColor,p,a,b,text);
+}
+
+void DisplayMemory::clear(Color color)
+{
+    clear(Point(0,0),Point(width-1,height-1),color);
+}
+
+void DisplayMemory::clear(Point p1, Point p2, Color color)
+{
+    accumulatedCost.calls++;
+    window(p1,p2,RD);
+    int numPixels=(p2.x()-p1.x()+1)*(p2.y()-p1.y()+1);
+    for(int i=0;i<numPixels;i++) writePixel(color);
+}
+
+void DisplayMemory::beginPixel() {}
+
+void DisplayMemory::setPixel(Point p, Color color)
+{
+    accumulatedCost.calls++;
+    accumulatedCost.windows++;
+    accumulatedCost.bytes+=cursorBytes+2;
+    if(p.x()<0 || p.y()<0 || p.x()>=width || p.y()>=height) return;
+    fb[p.x()+p.y()*width]=color;
+}
+
+void DisplayMemory::line(Point a, Point b, Color color)
+{
+    //Same optimizations of the hardware driver, to count the same cost
+    if(a.y()==b.y())
+    {
+        accumulatedCost.calls++;
+        window(Point(min(a.x(),b.x()),a.y()),Point(max(a.x(),b.x()),a.y()),RD);
+        int numPixels=abs(a.x()-b.x());
+        for(int i=0;i<=numPixels;i++) writePixel(color);
+        return;
+    }
+    if(a.x()==b.x())
+    {
+        accumulatedCost.calls++;
+        window(Point(a.x(),min(a.y(),b.y())),Point(a.x(),max(a.y(),b.y())),DR);
+        int numPixels=abs(a.y()-b.y());
+        for(int i=0;i<=numPixels;i++) writePixel(color);
+        return;
+    }
+    Line::draw(*this,a,b,color);
+}
+
+void DisplayMemory::scanLine(Point p, const Color *colors, unsigned short length)
+{
+    accumulatedCost.calls++;
+    length=min<unsigned short>(length,width-p.x());
+    window(p,Point(p.x()+length-1,p.y()),RD);
+    for(int i=0;i<length;i++) writePixel(colors[i]);
+}
+
+Color *DisplayMemory::getScanLineBuffer()
+{
+    return buffer;
+}
+
+void DisplayMemory::scanLineBuffer(Point p, unsigned short length)
+{
+    scanLine(p,buffer,length);
+}
+
+void DisplayMemory::drawImage(Point p, const ImageBase& img)
+{
+    accumulatedCost.calls++;
+    const Color *imgData=img.getData();
+    if(imgData!=0)
+    {
+        short int xEnd=p.x()+img.getWidth()-1;
+        short int yEnd=p.y()+img.getHeight()-1;
+        window(p,Point(xEnd,yEnd),RD);
+        int numPixels=img.getHeight()*img.getWidth();
+        for(int i=0;i<numPixels;i++) writePixel(imgData[i]);
+    } else img.draw(*this,p);
+}
+
+void DisplayMemory::clippedDrawImage(Point p, Point a, Point b, const ImageBase& img)
+{
+    accumulatedCost.calls++;
+    img.clippedDraw(*this,p,a,b);
+}
+
+void DisplayMemory::drawRectangle(Point a, Point b, Color c)
+{
+    line(a,Point(b.x(),a.y()),c);
+    line(Point(b.x(),a.y()),b,c);
+    line(b,Point(a.x(),b.y()),c);
+    line(Point(a.x(),b.y()),a,c);
+}
+
+DisplayMemory::pixel_iterator DisplayMemory::begin(Point p1, Point p2,
+        IteratorDirection d)
+{
+    if(p1.x()<0 || p1.y()<0 || p2.x()<0 || p2.y()<0) return pixel_iterator();
+    if(p1.x()>=width || p1.y()>=height || p2.x()>=width || p2.y()>=height)
+        return pixel_iterator();
+    if(p2.x()<p1.x() || p2.y()<p1.y()) return pixel_iterator();
+
+    window(p1,p2,d);
+    unsigned int numPixels=(p2.x()-p1.x()+1)*(p2.y()-p1.y()+1);
+    return pixel_iterator(this,numPixels);
+}
+
+DisplayMemory::~DisplayMemory() {}
+
+void DisplayMemory::window(Point p1, Point p2, IteratorDirection d)
+{
+    accumulatedCost.windows++;
+    accumulatedCost.bytes+=windowBytes;
+    x0=x=p1.x(); x1=p2.x();
+    y0=y=p1.y(); y1=p2.y();
+    direction=d;
+}
+
+void DisplayMemory::writePixel(Color c)
+{
+    accumulatedCost.bytes+=2;
+    if(x>=0 && y>=0 && x<width && y<height) fb[x+y*width]=c;
+    //Like the display controller, wrap around at the end of the window
+    if(direction==DR)
+    {
+        if(++y>y1) { y=y0; if(++x>x1) x=x0; }
+    } else {
+        if(++x>x1) { x=x0; if(++y>y1) y=y0; }
+    }
+}
+
+//
+// PNG encoding, using uncompressed deflate blocks to avoid depending on zlib
+//
+
+static unsigned int crc32(const unsigned char *data, size_t size,
+                          unsigned int crc=0)
+{
+    crc=~crc;
+    for(size_t i=0;i<size;i++)
+    {
+        crc^=data[i];
+        for(int j=0;j<8;j++) crc=(crc>>1)^(0xedb88320 & (0-(crc & 1)));
+    }
+    return ~crc;
+}
+
+static void put32(vector<unsigned char>& v, unsigned int x)
+{
+    v.push_back(x>>24); v.push_back(x>>16); v.push_back(x>>8); v.push_back(x);
+}
+
+static void pngChunk(FILE *f, const char *type, const vector<unsigned char>& data)
+{
+    vector<unsigned char> chunk;
+    put32(chunk,data.size());
+    chunk.insert(chunk.end(),type,type+4);
+    chunk.insert(chunk.end(),data.begin(),data.end());
+    put32(chunk,crc32(chunk.data()+4,chunk.size()-4));
+    fwrite(chunk.data(),1,chunk.size(),f);
+}
+
+bool DisplayMemory::savePng(const string& filename) const
+{
+    //Raw image data: each row is a filter type byte (none) followed by RGB
+    vector<unsigned char> raw;
+    for(int i=0;i<height;i++)
+    {
+        raw.push_back(0);
+        for(int j=0;j<width;j++)
+        {
+            Color c=fb[j+i*width];
+            unsigned char r=(c>>11)<<3, g=((c>>5) & 0x3f)<<2, b=(c & 0x1f)<<3;
+            raw.push_back(r | r>>5); raw.push_back(g | g>>6); raw.push_back(b | b>>5);
+        }
+    }
+    //zlib stream made of stored blocks
+    vector<unsigned char> idat={0x78,0x01};
+    for(size_t i=0;i<raw.size();i+=65535)
+    {
+        unsigned short len=min<size_t>(65535,raw.size()-i);
+        idat.push_back(i+len==raw.size() ? 1 : 0);
+        idat.push_back(len); idat.push_back(len>>8);
+        idat.push_back(~len); idat.push_back((~len)>>8);
+        idat.insert(idat.end(),raw.begin()+i,raw.begin()+i+len);
+    }
+    unsigned int a=1, b=0;
+    for(auto x : raw) { a=(a+x)%65521; b=(b+a)%65521; }
+    put32(idat,b<<16 | a);
+
+    FILE *f=fopen(filename.c_str(),"wb");
+    if(f==nullptr) return false;
+    const unsigned char signature[]={0x89,'P','N','G','\r','\n',0x1a,'\n'};
+    fwrite(signature,1,sizeof(signature),f);
+    vector<unsigned char> ihdr;
+    put32(ihdr,width);
+    put32(ihdr,height);
+    ihdr.insert(ihdr.end(),{8,2,0,0,0}); //8 bit RGB, no interlace
+    pngChunk(f,"IHDR",ihdr);
+    pngChunk(f,"IDAT",idat);
+    pngChunk(f,"IEND",{});
+    return fclose(f)==0;
+}
+
+} //namespace mxgui
@@ -0,0 +1,213 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+/*
+ * Headless UI driver. Runs ApplicationUI on the host drawing into a memory
+ * framebuffer, following a script read from standard input, one command per
+ * line:
+ *
+ * frame [n]       render n frames (default 1)
+ * press up|on     short press of a button
+ * hold up|on ms   keep a button pressed for ms milliseconds
+ * wait ms         keep updating the UI for ms milliseconds
+ * cost label      print the drawing cost since the last cost command
+ * snap file.png   save a screenshot
+ *
+ * Lines starting with # are ignored. Example:
+ * echo -e "frame 8\ncost main\npress up\ncost menu\nsnap menu.png" | ./headless
+ */
+
+#include "display_memory.h"
+#include "../qtsimulator/frame_source.hpp"
+#include "../../applicationui.h"
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <chrono>
+
+using namespace std;
+using namespace mxgui;
+
+void registerDisplayHook(DisplayManager& dm)
+{
+    dm.registerDisplay(new DisplayMemory);
+}
+
+class ApplicationHeadless : IOHandlerBase
+{
+public:
+    ApplicationHeadless(DisplayMemory& display, FrameSource *frameSrc) :
+        display(display), ui(*this, display, {false, false}),
+        frameSrc(frameSrc) {}
+
+    int run(istream& script)
+    {
+        ui.lifecycle = ApplicationUI<ApplicationHeadless>::Ready;
+        ui.update();
+        string line;
+        while(getline(script,line))
+        {
+            istringstream ss(line);
+            string cmd, arg;
+            ss>>cmd;
+            if(cmd.empty() || cmd[0]=='#') continue;
+            if(cmd=="frame")
+            {
+                int n=1;
+                ss>>n;
+                for(int i=0;i<n;i++)
+                {
+                    frameSrc->setEmissivity(ui.options.emissivity);
+                    updateFrame();
+                    ui.update();
+                }
+            } else if(cmd=="press" && ss>>arg) {
+                if(button(arg,true)==false) return error(line);
+                ui.update();
+                button(arg,false);
+                ui.update();
+            } else if(cmd=="hold" && ss>>arg) {
+                int ms=0;
+                ss>>ms;
+                if(button(arg,true)==false) return error(line);
+                updateFor(ms);
+                button(arg,false);
+                ui.update();
+            } else if(cmd=="wait") {
+                int ms=0;
+                ss>>ms;
+                updateFor(ms);
+            } else if(cmd=="cost") {
+                ss>>arg;
+                const DisplayCost& c=display.cost();
+                printf("%-12s calls=%-5u windows=%-5u bytes=%-6u spi=%uus\n",
+                       arg.c_str(),c.calls,c.windows,c.bytes,c.spiTimeUs());
+                display.resetCost();
+            } else if(cmd=="snap" && ss>>arg) {
+                if(display.savePng(arg)==false) return error(line);
+            } else return error(line);
+            if(ui.lifecycle == ApplicationUI<ApplicationHeadless>::Quit) break;
+        }
+        return 0;
+    }
+
+    ButtonState checkButtons()
+    {
+        return buttons;
+    }
+
+    BatteryLevel checkBatteryLevel()
+    {
+        return BatteryLevel::B50;
+    }
+
+    bool checkUSBConnected()
+    {
+        return true;
+    }
+
+    void setPause(bool paused) {}
+
+    void saveOptions(ApplicationOptions& options) {}
+
+    int captureSnapshot()
+    {
+        //Snapshots are kept in memory, already processed
+        if(hasFrame==false) return -1;
+        snapshots.push_back({lastFrame,ui.options.emissivity});
+        return snapshots.size()-1;
+    }
+
+    int snapshotCount()
+    {
+        return snapshots.size();
+    }
+
+    bool loadSnapshot(int index, MLX90640Frame *frame, float& emissivity)
+    {
+        *frame=snapshots.at(index).first;
+        emissivity=snapshots.at(index).second;
+        return true;
+    }
+
+private:
+    void updateFrame()
+    {
+        //A copy is kept for snapshots, the UI takes ownership of the frame
+        auto frame=frameSrc->getLastFrame();
+        if(ui.paused==false)
+        {
+            lastFrame=*frame;
+            hasFrame=true;
+        }
+        ui.updateFrame(frame.release());
+    }
+
+    bool button(const string& name, bool pressed)
+    {
+        if(name=="up") buttons.up=pressed;
+        else if(name=="on") buttons.on=pressed;
+        else return false;
+        return true;
+    }
+
+    void updateFor(int ms)
+    {
+        auto end=chrono::steady_clock::now()+chrono::milliseconds(ms);
+        do {
+            ui.update();
+            this_thread::sleep_for(chrono::milliseconds(10));
+        } while(chrono::steady_clock::now()<end);
+    }
+
+    int error(const string& line)
+    {
+        fprintf(stderr,"Error: %s\n",line.c_str());
+        return 1;
+    }
+
+    DisplayMemory& display;
+    ButtonState buttons = ButtonState(0, 0);
+    ApplicationUI<ApplicationHeadless> ui;
+    FrameSource *frameSrc;
+    MLX90640Frame lastFrame;
+    bool hasFrame=false;
+    std::vector<std::pair<MLX90640Frame,float>> snapshots;
+};
+
+int main(int argc, char *argv[])
+{
+    unique_ptr<FrameSource> source;
+    if(argc==2) source.reset(new DeviceFrameSource(argv[1]));
+    else source.reset(new DummyFrameSource());
+    auto& display=static_cast<DisplayMemory&>(DisplayManager::instance().getDisplay());
+    ApplicationHeadless application(display,source.get());
+    int result=application.run(cin);
+    source->stop();
+    return result;
+}
@@ -26,10 +26,19 @@
  ***************************************************************************/
 
 #include "frame_source.hpp"
+#include "../../drivers/usb_protocol.h"
+#include "../../drivers/frame_codec.h"
 #include <cstdio>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <chrono>
 #include <unistd.h>
 #include <fcntl.h>
 #include <termios.h>
+#ifdef HAVE_LIBUSB
+#include <libusb.h>
+#endif
 #include <sys/file.h>
 
 std::unique_ptr<MLX90640Frame> DummyFrameSource::getLastFrame()
@@ -59,7 +68,9 @@ std::unique_ptr<MLX90640Frame> DummyFrameSource::getLastFrame()
         74, 73, 75, 74, 77, 80,109,111,115,117,120,120,121,119,116,114,111,109,109,110,110,108,105,106, 98, 88, 78, 74, 74, 70, 70, 70,
         74, 74, 72, 75, 78, 81,106,111,115,116,119,121,118,119,113,113,110,109,109,110,109,106,104,106, 84, 79, 73, 73, 71, 71, 69, 69,
         76, 74, 76, 72, 79, 85,108,108,113,115,119,119,117,115,111,110,110,110,110,108,108,107,105,100, 79, 77, 73, 73, 70, 71, 70, 68}};
-    return std::unique_ptr<MLX90640Frame>(new MLX90640Frame(testFrame));
+    auto frame = std::unique_ptr<MLX90640Frame>(new MLX90640Frame(testFrame));
+    frame->computeStats();
+    return frame;
 }
 
 DeviceFrameSource::DeviceFrameSource(std::string devicePath)
@@ -149,6 +160,253 @@ static void setTTYAttr(int fd)
     tcsetattr(fd, TCSANOW, &tty);
 }
 
+// Raw mode for the binary protocol, where no byte must be interpreted. With a
+// timeout, in tenths of a second, reads return nothing if no data arrives
+static void setTTYRawAttr(int fd, int timeout = 0)
+{
+    struct termios tty;
+    tcgetattr(fd, &tty);
+    cfmakeraw(&tty);
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cc[VTIME] = timeout;      // Timer started at each read
+    tty.c_cc[VMIN] = timeout ? 0 : 1; // Else blocking read until 1 character received
+    tcsetattr(fd, TCSANOW, &tty);
+}
+
+#ifdef HAVE_LIBUSB
+// Reads the binary packets from the bulk IN endpoint of the vendor interface,
+// bypassing the tty layer. Transfers time out periodically so that a stopped
+// source does not block forever
+class BulkReader
+{
+public:
+    BulkReader(const std::atomic<bool>& stopped) : stopped(stopped) {}
+
+    bool open()
+    {
+        if (libusb_init(&ctx) != 0) {
+            ctx = nullptr;
+            return false;
+        }
+        handle = libusb_open_device_with_vid_pid(ctx, usbVendorId, usbProductId);
+        if (handle == nullptr) return false;
+        libusb_set_auto_detach_kernel_driver(handle, 1);
+        if (libusb_claim_interface(handle, usbBulkInterface) != 0) {
+            libusb_close(handle);
+            handle = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    bool read(uint8_t *buf, size_t size, const std::function<void()>& idle)
+    {
+        while (size > 0)
+        {
+            if (begin == end) {
+                if (stopped) return false;
+                int transferred = 0;
+                int r = libusb_bulk_transfer(handle, usbBulkInEndpoint, buffer,
+                                             sizeof(buffer), &transferred, 200);
+                if (r != 0 && r != LIBUSB_ERROR_TIMEOUT) {
+                    fprintf(stderr, "bulk transfer error %d\n", r);
+                    return false;
+                }
+                begin = 0;
+                end = transferred;
+                if (transferred == 0) idle();
+                continue;
+            }
+            size_t n = std::min<size_t>(size, end - begin);
+            memcpy(buf, buffer + begin, n);
+            begin += n;
+            buf += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    ~BulkReader()
+    {
+        if (handle) {
+            libusb_release_interface(handle, usbBulkInterface);
+            libusb_close(handle);
+        }
+        if (ctx) libusb_exit(ctx);
+    }
+
+private:
+    BulkReader(const BulkReader&) = delete;
+    BulkReader& operator=(const BulkReader&) = delete;
+
+    const std::atomic<bool>& stopped;
+    libusb_context *ctx = nullptr;
+    libusb_device_handle *handle = nullptr;
+    uint8_t buffer[16384]; // Multiple of the packet size, can't overflow
+    size_t begin = 0, end = 0;
+};
+#endif
+
+// Read one binary packet, resynchronizing on the sync word and skipping
+// packets with a bad length or CRC. Returns false on end of stream
+static bool readPacket(const StreamReader& read, const std::function<void()>& idle,
+                       std::vector<uint8_t>& packet)
+{
+    const int sync0 = usbPacketSync & 0xff, sync1 = usbPacketSync >> 8;
+    for (;;)
+    {
+        uint8_t prev = 0, c = 0;
+        do {
+            prev = c;
+            if (!read(&c, 1, idle)) return false;
+        } while (prev != sync0 || c != sync1);
+        UsbPacketHeader header;
+        packet.resize(sizeof(header));
+        packet[0] = sync0;
+        packet[1] = sync1;
+        if (!read(packet.data()+2, sizeof(header)-2, idle))
+            return false;
+        memcpy(&header, packet.data(), sizeof(header));
+        if (header.length > usbMaxPayloadSize) {
+            fprintf(stderr, "bad packet length %d\n", header.length);
+            continue;
+        }
+        size_t rest = header.length + usbPacketCrcSize;
+        packet.resize(sizeof(header) + rest);
+        if (!read(packet.data()+sizeof(header), rest, idle))
+            return false;
+        uint16_t crc;
+        memcpy(&crc, packet.data()+packet.size()-usbPacketCrcSize, sizeof(crc));
+        if (crc == crc16Update(crc16Init, packet.data(), packet.size()-usbPacketCrcSize))
+            return true;
+        fprintf(stderr, "bad packet CRC\n");
+    }
+}
+
+void DeviceFrameSource::readHexStream(FILE *fp, paramsMLX90640& params)
+{
+    const size_t charBufSz = 10000;
+    char buf[charBufSz];
+
+    fprintf(fp, "start_stream\n");
+
+    while (!stopped && !feof(fp))
+    {
+        MLX90640RawFrame rawFrame;
+        fgets(buf, charBufSz, fp);
+        if (feof(fp))
+            break;
+        parseHex(buf+2, sizeof(rawFrame.subframe[0]), rawFrame.subframe[0]);
+        fgets(buf, charBufSz, fp);
+        if (feof(fp))
+            break;
+        parseHex(buf+2, sizeof(rawFrame.subframe[1]), rawFrame.subframe[1]);
+
+        MLX90640Frame newFrame;
+        rawFrame.process(&newFrame, params, emiss.load());
+        {
+            std::lock_guard<std::mutex> lock(lastFrameMutex);
+            lastFrame = newFrame;
+        }
+    }
+}
+
+void DeviceFrameSource::readBinaryStream(FILE *fp, const StreamReader& read,
+                                         paramsMLX90640& params, int creditWindow)
+{
+    std::vector<uint8_t> packet;
+    bool first = true;
+    uint32_t expectedSequence = 0;
+    // With flow control, grant credit again once half of it is used. Credit is
+    // written to the fd directly, as the FILE is being read
+    int credit = creditWindow;
+    auto grant = [&]() {
+        char cmd[32];
+        int len = snprintf(cmd, sizeof(cmd), "credit %d\n", creditWindow - credit);
+        write(fileno(fp), cmd, len);
+        credit = creditWindow;
+    };
+    // If no packet arrives for longer than a frame period at the lowest frame
+    // rate, the device may have run out of credit, as credit commands can be
+    // lost. Grant the whole window again, once until the next packet, so
+    // that credit does not grow while the device is paused
+    using Clock = std::chrono::steady_clock;
+    const auto creditTimeout = std::chrono::seconds(3);
+    auto lastPacket = Clock::now();
+    bool regranted = false;
+    auto idle = [&]() {
+        if (creditWindow <= 0 || regranted || Clock::now() - lastPacket < creditTimeout)
+            return;
+        fprintf(stderr, "no packets, granting credit again\n");
+        credit = 0;
+        grant();
+        regranted = true;
+    };
+    // Compressed frames are deltas from the previous frame of the same type
+    FrameDecoder rawDecoder(2*834);
+    FrameDecoder processedDecoder(32*24);
+    while (!stopped && readPacket(read, idle, packet))
+    {
+        lastPacket = Clock::now();
+        regranted = false;
+        UsbPacketHeader header;
+        memcpy(&header, packet.data(), sizeof(header));
+        uint32_t lost = first ? 0 : header.sequence - expectedSequence;
+        if (lost != 0) {
+            fprintf(stderr, "lost %u frames\n", lost);
+            rawDecoder.invalidate();
+            processedDecoder.invalidate();
+        }
+        if (header.skipped != 0)
+            fprintf(stderr, "device skipped %u frames\n", header.skipped);
+        first = false;
+        expectedSequence = header.sequence + 1;
+        if (creditWindow > 0) {
+            // Lost packets consumed credit too
+            credit = std::max<long long>(0, credit - 1LL - lost);
+            if (credit <= creditWindow / 2) grant();
+        }
+        const uint8_t *payload = packet.data()+sizeof(header);
+        bool compressed = header.flags & usbPacketCompressed;
+        bool keyframe = header.flags & usbPacketKeyframe;
+
+        MLX90640Frame newFrame;
+        if (header.type == static_cast<uint8_t>(UsbPacketType::RawFrame)) {
+            MLX90640RawFrame rawFrame;
+            if (compressed) {
+                if (!rawDecoder.decode(payload, header.length, keyframe, &rawFrame.subframe[0][0]))
+                    continue;
+            } else {
+                if (header.length != sizeof(rawFrame.subframe))
+                    continue;
+                memcpy(rawFrame.subframe, payload, sizeof(rawFrame.subframe));
+            }
+            rawFrame.timestamp = header.timestamp;
+            rawFrame.process(&newFrame, params, emiss.load());
+        } else if (header.type == static_cast<uint8_t>(UsbPacketType::ProcessedFrame)) {
+            // Already converted with the emissivity set on the device
+            if (header.length < sizeof(UsbFrameStats))
+                continue;
+            const uint8_t *temperature = payload+sizeof(UsbFrameStats);
+            int size = header.length-sizeof(UsbFrameStats);
+            if (compressed) {
+                auto *out = reinterpret_cast<uint16_t *>(newFrame.temperature);
+                if (!processedDecoder.decode(temperature, size, keyframe, out))
+                    continue;
+            } else {
+                if (size != sizeof(newFrame.temperature))
+                    continue;
+                memcpy(newFrame.temperature, temperature, sizeof(newFrame.temperature));
+            }
+            newFrame.computeStats();
+        } else continue;
+        {
+            std::lock_guard<std::mutex> lock(lastFrameMutex);
+            lastFrame = newFrame;
+        }
+    }
+}
+
 void DeviceFrameSource::connect(const char *cstr)
 {
     fprintf(stderr, "new connection attempt to %s\n", cstr);
@@ -200,31 +458,79 @@ void DeviceFrameSource::connect(const char *cstr)
     fprintf(fp, "get_eeprom\n");
     fgets(buf, charBufSz, fp);
     fprintf(stderr, "eeprom=%s", buf);
-    size_t sz = parseHex(buf, sizeof(eeprom.eeprom), eeprom.eeprom);
+    parseHex(buf, sizeof(eeprom.eeprom), eeprom.eeprom);
     paramsMLX90640 mlx90640;
     MLX90640_ExtractParameters(eeprom.eeprom, &mlx90640);
 
-    fprintf(fp, "start_stream\n");
+    // Try the compressed binary protocol with flow control first, then without
+    // flow control, then the uncompressed one.
+    // The TTY goes in raw mode before sending the command, so that no byte of
+    // the first packets gets interpreted. Firmware without support for a
+    // command replies with an error line instead
+    fflush(fp);
+    setTTYRawAttr(fd);
+    auto readReply = [fp]() {
+        std::string reply;
+        for (int c; (c = fgetc(fp)) != EOF && c != '\n';)
+            if (c != '\r') reply += c;
+        return reply;
+    };
 
-    while (!stopped && !feof(fp))
+    // Binary stream reads time out, nothing read means no data for a while
+    StreamReader read = [this, fp](uint8_t *buf, size_t size,
+                                   const std::function<void()>& idle) {
+        while (size > 0) {
+            size_t n = fread(buf, 1, size, fp);
+            buf += n;
+            size -= n;
+            if (size == 0) break;
+            if (ferror(fp) || stopped) return false;
+            clearerr(fp);
+            idle();
+        }
+        return true;
+    };
+    #ifdef HAVE_LIBUSB
+    // If possible packets come from the vendor bulk interface, commands and
+    // their replies still go through the tty
+    BulkReader bulk(stopped);
+    if (bulk.open()) {
+        fprintf(fp, "stream_to_bulk\n");
+        fflush(fp);
+        if (readReply() == "bulk") {
+            fprintf(stderr, "using bulk interface\n");
+            read = [&bulk](uint8_t *buf, size_t size, const std::function<void()>& idle) {
+                return bulk.read(buf, size, idle);
+            };
+        }
+    }
+    #endif
+
+    bool binary = false;
+    const int creditWindow = 8;
+    int flowControl = 0;
+    std::string withCredit = "start_stream_binary_compressed " + std::to_string(creditWindow);
+    for (const char *cmd : {withCredit.c_str(), "start_stream_binary_compressed",
+                            "start_stream_binary"})
     {
-        MLX90640RawFrame rawFrame;
-        fgets(buf, charBufSz, fp);
-        if (feof(fp))
+        fprintf(fp, "%s\n", cmd);
+        fflush(fp);
+        if (readReply() == "binary") {
+            binary = true;
+            // Only the first command enables flow control
+            if (cmd == withCredit.c_str()) flowControl = creditWindow;
             break;
-        sz = parseHex(buf+2, sizeof(rawFrame.subframe[0]), rawFrame.subframe[0]);
-        fgets(buf, charBufSz, fp);
-        if (feof(fp))
-            break;
-        sz = parseHex(buf+2, sizeof(rawFrame.subframe[1]), rawFrame.subframe[1]);
-
-        MLX90640Frame newFrame;
-        rawFrame.process(&newFrame, mlx90640, emiss.load());
-        {
-            std::lock_guard<std::mutex> lock(lastFrameMutex);
-            lastFrame = newFrame;
         }
     }
+    if (binary) {
+        fprintf(stderr, "using binary protocol\n");
+        setTTYRawAttr(fd, 5);
+        readBinaryStream(fp, read, mlx90640, flowControl);
+    } else {
+        fprintf(stderr, "using hex protocol\n");
+        setTTYAttr(fd);
+        readHexStream(fp, mlx90640);
+    }
 
     fprintf(fp, "stop_stream\n");
 
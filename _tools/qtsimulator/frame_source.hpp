@@ -30,9 +30,16 @@
 #include "../../drivers/mlx90640frame.h"
 #include <memory>
 #include <string>
+#include <cstdio>
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <functional>
+
+/// Reads exactly size bytes of a packet stream, false on end of stream. While
+/// waiting, idle is called periodically when no data arrives
+using StreamReader = std::function<bool(uint8_t *buf, size_t size,
+                                        const std::function<void()>& idle)>;
 
 class FrameSource
 {
@@ -61,6 +68,9 @@ class DeviceFrameSource : public FrameSource
 
     void ioThreadMain(std::string devicePath);
     void connect(const char *cstr);
+    void readHexStream(FILE *fp, paramsMLX90640& params);
+    void readBinaryStream(FILE *fp, const StreamReader& read,
+                          paramsMLX90640& params, int creditWindow);
 public:
     DeviceFrameSource(std::string devicePath);
     ~DeviceFrameSource()
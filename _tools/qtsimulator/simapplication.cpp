@@ -31,6 +31,7 @@
 #include "mxgui/display.h"
 #include "mxgui/level2/input.h"
 #include <thread>
+#include <vector>
 #include <chrono>
 #include <QApplication>
 
@@ -48,11 +49,11 @@ public:
         std::this_thread::sleep_for(std::chrono::milliseconds(700));
         ui.lifecycle = ApplicationUI<ApplicationSimulator>::Ready;
         frameSrc->setEmissivity(ui.options.emissivity);
-        ui.updateFrame(frameSrc->getLastFrame().release());
+        updateFrame();
         while (ui.lifecycle != ApplicationUI<ApplicationSimulator>::Quit) {
             ui.update();
             frameSrc->setEmissivity(ui.options.emissivity);
-            ui.updateFrame(frameSrc->getLastFrame().release());
+            updateFrame();
             std::this_thread::sleep_for(std::chrono::microseconds(16666));
         }
     }
@@ -100,10 +101,45 @@ public:
         printf("saved options\n");
     }
 
+    int captureSnapshot()
+    {
+        //Snapshots are kept in memory, already processed
+        if(hasFrame==false) return -1;
+        snapshots.push_back({lastFrame,ui.options.emissivity});
+        return snapshots.size()-1;
+    }
+
+    int snapshotCount()
+    {
+        return snapshots.size();
+    }
+
+    bool loadSnapshot(int index, MLX90640Frame *frame, float& emissivity)
+    {
+        *frame=snapshots.at(index).first;
+        emissivity=snapshots.at(index).second;
+        return true;
+    }
+
 private:
+    void updateFrame()
+    {
+        //A copy is kept for snapshots, the UI takes ownership of the frame
+        auto frame=frameSrc->getLastFrame();
+        if(ui.paused==false)
+        {
+            lastFrame=*frame;
+            hasFrame=true;
+        }
+        ui.updateFrame(frame.release());
+    }
+
     ButtonState buttons = ButtonState(0, 0);
     ApplicationUI<ApplicationSimulator> ui;
     FrameSource *frameSrc;
+    MLX90640Frame lastFrame;
+    bool hasFrame=false;
+    std::vector<std::pair<MLX90640Frame,float>> snapshots;
 };
 
 ENTRY()
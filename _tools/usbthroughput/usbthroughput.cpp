@@ -0,0 +1,201 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+/*
+ * USB throughput test. Sends a binary stream command to the camera and
+ * reports the rate of valid packets received, in MB/s and frames/s.
+ *
+ * usbthroughput <device> <command> [seconds]
+ *
+ * Examples:
+ * ./usbthroughput /dev/ttyACM0 "test_stream 500"
+ * ./usbthroughput /dev/ttyACM0 "start_stream_binary_compressed 8" 30
+ *
+ * test_stream sends packets as fast as possible, so it measures the USB link
+ * alone, while the stream commands are limited by the sensor frame rate. If a
+ * stream command has a credit argument, credit is granted like the simulator
+ * does. The test ends after the given time (10s by default) or after one
+ * second without data.
+ */
+
+#include "../../drivers/usb_protocol.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+
+using namespace std;
+using namespace std::chrono;
+
+static void setTTYRawAttr(int fd)
+{
+    struct termios tty;
+    tcgetattr(fd, &tty);
+    cfmakeraw(&tty);
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cc[VTIME] = 0;
+    tty.c_cc[VMIN] = 1;
+    tcsetattr(fd, TCSANOW, &tty);
+}
+
+static void writeLine(int fd, const string& line)
+{
+    string s = line + "\n";
+    if (write(fd, s.data(), s.size()) != static_cast<ssize_t>(s.size()))
+        perror("write");
+}
+
+// Read a line, without the line ending. Returns false on timeout
+static bool readLine(int fd, string& line, int timeoutMs)
+{
+    line.clear();
+    for (;;)
+    {
+        pollfd p = { fd, POLLIN, 0 };
+        if (poll(&p, 1, timeoutMs) <= 0) return false;
+        char c;
+        if (read(fd, &c, 1) != 1) return false;
+        if (c == '\n') return true;
+        if (c != '\r') line += c;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: usbthroughput <device> <command> [seconds]\n");
+        return 1;
+    }
+    string command = argv[2];
+    double maxSeconds = argc > 3 ? atof(argv[3]) : 10.0;
+    int creditWindow = 0;
+    auto space = command.find(' ');
+    if (command.compare(0, 12, "start_stream") == 0 && space != string::npos)
+        creditWindow = atoi(command.c_str() + space + 1);
+
+    int fd = open(argv[1], O_RDWR | O_NOCTTY);
+    if (fd < 0)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    setTTYRawAttr(fd);
+    writeLine(fd, "stop_stream");
+    usleep(100 * 1000);
+    tcflush(fd, TCIOFLUSH);
+    writeLine(fd, command);
+    string reply;
+    // Skip the reply to the empty line, if any
+    while (readLine(fd, reply, 1000) && reply != "binary") ;
+    if (reply != "binary")
+    {
+        fprintf(stderr, "no binary stream, reply \"%s\"\n", reply.c_str());
+        close(fd);
+        return 1;
+    }
+
+    vector<uint8_t> buffer;
+    long long packets = 0, bytes = 0, lost = 0, skipped = 0, badCrc = 0;
+    uint32_t expectedSequence = 0;
+    int credit = creditWindow;
+    auto start = steady_clock::now();
+    steady_clock::time_point first, last;
+    while (duration_cast<duration<double>>(steady_clock::now() - start).count() < maxSeconds)
+    {
+        pollfd p = { fd, POLLIN, 0 };
+        if (poll(&p, 1, 1000) <= 0) break;
+        uint8_t data[4096];
+        ssize_t n = read(fd, data, sizeof(data));
+        if (n <= 0) break;
+        buffer.insert(buffer.end(), data, data + n);
+
+        // Parse all complete packets in the buffer
+        const uint8_t sync[] = { usbPacketSync & 0xff, usbPacketSync >> 8 };
+        for (;;)
+        {
+            auto it = search(buffer.begin(), buffer.end(), sync, sync + 2);
+            buffer.erase(buffer.begin(), it);
+            if (buffer.size() < sizeof(UsbPacketHeader)) break;
+            UsbPacketHeader header;
+            memcpy(&header, buffer.data(), sizeof(header));
+            if (header.length > usbMaxPayloadSize)
+            {
+                buffer.erase(buffer.begin());
+                continue;
+            }
+            size_t size = sizeof(header) + header.length + usbPacketCrcSize;
+            if (buffer.size() < size) break;
+            uint16_t crc;
+            memcpy(&crc, buffer.data() + size - usbPacketCrcSize, sizeof(crc));
+            if (crc != crc16Update(crc16Init, buffer.data(), size - usbPacketCrcSize))
+            {
+                badCrc++;
+                buffer.erase(buffer.begin());
+                continue;
+            }
+            buffer.erase(buffer.begin(), buffer.begin() + size);
+
+            last = steady_clock::now();
+            if (packets == 0) first = last;
+            else
+            {
+                // Rates count the packets after the first one
+                bytes += size;
+                lost += header.sequence - expectedSequence;
+            }
+            packets++;
+            skipped += header.skipped;
+            expectedSequence = header.sequence + 1;
+            if (creditWindow > 0 && --credit <= creditWindow / 2)
+            {
+                writeLine(fd, "credit " + to_string(creditWindow - credit));
+                credit = creditWindow;
+            }
+        }
+    }
+    writeLine(fd, "stop_stream");
+    close(fd);
+
+    double seconds = duration_cast<duration<double>>(last - first).count();
+    printf("%lld packets, %lld lost, %lld skipped by the device, %lld bad CRC\n",
+           packets, lost, skipped, badCrc);
+    if (packets < 2 || seconds <= 0)
+    {
+        printf("not enough packets to measure throughput\n");
+        return 1;
+    }
+    printf("%.3f MB/s, %.2f frames/s\n", bytes / seconds / 1e6, (packets - 1) / seconds);
+    return 0;
+}
@@ -29,6 +29,9 @@
 #include <mxgui/misc_inst.h>
 #include <drivers/misc.h>
 #include <drivers/options_save.h>
+#include <drivers/usb_protocol.h>
+#include <drivers/frame_codec.h>
+#include <drivers/flash.h>
 #include <images/batt100icon.h>
 #include <images/batt75icon.h>
 #include <images/batt50icon.h>
@@ -39,6 +42,9 @@
 #include <images/smallcelsiusicon.h>
 #include <images/largecelsiusicon.h>
 #include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdlib.h>
 
 using namespace std;
 using namespace miosix;
@@ -57,9 +63,15 @@ using namespace mxgui;
 Application::Application(Display& display)
     : display(display), ui(*this, display, ButtonState(1^up_btn::value(),on_btn::value())),
       i2c(make_unique<I2C1Master>(sen_sda::getPin(),sen_scl::getPin(),1000)),
-      sensor(make_unique<MLX90640>(i2c.get())), usb(make_unique<USBCDC>(Priority()))
+      sensor(make_unique<MLX90640>(i2c.get())), usb(make_unique<USBCDC>(Priority())),
+      recorder(make_unique<FrameRecorder>()), snapshots(make_unique<SnapshotStore>()),
+      lastRaw(make_unique<MLX90640RawFrame>())
 {
-    loadOptions(&ui.options,sizeof(ui.options));
+    //Options saved by older firmware are version 0, and their layout is a
+    //prefix of the current one
+    if(loadOptions(applicationOptionsType,applicationOptionsVersion,
+                   &ui.options,sizeof(ui.options))==false)
+        loadOptions(applicationOptionsType,0,&ui.options,sizeof(ui.options));
     if(sensor->setRefresh(refreshFromInt(ui.options.frameRate))==false)
         puts("Error setting framerate");
     display.setBrightness(ui.options.brightness * 6);
@@ -67,6 +79,8 @@ Application::Application(Display& display)
 
 void Application::run()
 {
+    recorder->start();
+    snapshots->start();
     //High priority for sensor read, prevents I2C reads from starving
     sensorThread = Thread::create(Application::sensorThreadMainTramp, 2048U, Priority(DEFAULT_PRIORITY+1), static_cast<void*>(this), Thread::JOINABLE);
     //Low priority for processing, prevents display writes from starving
@@ -82,13 +96,38 @@ void Application::run()
     Thread *usbInteractiveThread = Thread::create(Application::usbThreadMainTramp, 2048U, Priority(), static_cast<void*>(this), Thread::JOINABLE);
     Thread *usbOutputThread = Thread::create(Application::usbFrameOutputThreadMainTramp, 2048U, Priority(), static_cast<void*>(this), Thread::JOINABLE);
     
+    //The UI thread sleeps until a button changes state, sampling the buttons
+    //periodically only while pressed, as long press and autorepeat are
+    //time-based. Sampling no faster than buttonPeriod also debounces them.
+    //Battery and USB state change slowly, and have their own periods
+    const long long buttonPeriod  =   20000000LL; //20ms
+    const long long usbPeriod     =  250000000LL; //250ms
+    const long long batteryPeriod = 2000000000LL; //2s
+    long long lastButtonUpdate=0, nextUsbUpdate=0, nextBatteryUpdate=0;
+    enableButtonInterrupts();
     ui.lifecycle = UI::Ready;
     while (ui.lifecycle != UI::Quit) {
+        long long now = getTime();
+        if (now < lastButtonUpdate + buttonPeriod) {
+            Thread::nanoSleepUntil(lastButtonUpdate + buttonPeriod);
+            now = getTime();
+        }
+        lastButtonUpdate = now;
         //auto t1 = miosix::getTime();
-        ui.update();
+        ui.updateButtons();
         //auto t2 = miosix::getTime();
         //iprintf("ui update = %lld\n",t2-t1);
-        Thread::sleep(80);
+        if (now >= nextUsbUpdate) {
+            ui.updateUSB();
+            nextUsbUpdate = now + usbPeriod;
+        }
+        if (now >= nextBatteryUpdate) {
+            ui.updateBattery();
+            nextBatteryUpdate = now + batteryPeriod;
+        }
+        long long wakeup = min(nextUsbUpdate, nextBatteryUpdate);
+        if (ui.buttonsPressed()) wakeup = min(wakeup, now + buttonPeriod);
+        waitForButtonEvent(wakeup);
     }
 
     usb->prepareShutdown();
@@ -99,10 +138,14 @@ void Application::run()
     if(rawFrameQueue.isEmpty()) rawFrameQueue.put(nullptr); //Prevents deadlock
     processThread->join();
     iprintf("processThread joined\n");
+    recorder->stop();
+    iprintf("recorder stopped\n");
+    snapshots->stop();
+    iprintf("snapshots stopped\n");
     if(processedFrameQueue.isEmpty()) processedFrameQueue.put(nullptr); //Prevents deadlock
     renderThread->join();
     iprintf("renderThread joined\n");
-    if(usbOutputQueue.isEmpty()) usbOutputQueue.put(nullptr);
+    if(usbOutputQueue.isEmpty()) usbOutputQueue.put({nullptr,nullptr});
     usbOutputThread->join();
     iprintf("usbOutputThread joined\n");
     usbInteractiveThread->join();
@@ -117,8 +160,8 @@ ButtonState Application::checkButtons()
 
 BatteryLevel Application::checkBatteryLevel()
 {
-    prevBatteryVoltage=min(prevBatteryVoltage,getBatteryVoltage());
-    return batteryLevel(prevBatteryVoltage);
+    battery.update(getBatteryMillivolts(),getTime());
+    return battery.level();
 }
 
 bool Application::checkUSBConnected()
@@ -133,7 +176,42 @@ void Application::setPause(bool pause)
 
 void Application::saveOptions(ApplicationOptions& options)
 {
-    ::saveOptions(&options,sizeof(options));
+    ::saveOptions(applicationOptionsType,applicationOptionsVersion,
+                  &options,sizeof(options));
+}
+
+int Application::captureSnapshot()
+{
+    //Copied here, the snapshot thread does the slow FLASH writes
+    auto *frame=new MLX90640RawFrame;
+    float emissivity;
+    {
+        Lock<FastMutex> lock(lastRawMutex);
+        *frame=*lastRaw;
+        emissivity=lastRawEmissivity;
+    }
+    if(frame->timestamp==0)
+    {
+        delete frame; //No frame processed yet
+        return -1;
+    }
+    return snapshots->capture(frame,emissivity);
+}
+
+int Application::snapshotCount()
+{
+    return snapshots->count();
+}
+
+bool Application::loadSnapshot(int index, MLX90640Frame *frame, float& emissivity)
+{
+    //Processed with the emissivity it was captured with
+    std::unique_ptr<MLX90640RawFrame> raw(new MLX90640RawFrame);
+    SnapshotStore::Info info;
+    if(snapshots->read(index,raw.get(),info)==false) return false;
+    sensor->processFrame(raw.get(),frame,info.emissivity);
+    emissivity=info.emissivity;
+    return true;
 }
 
 void *Application::sensorThreadMainTramp(void *p)
@@ -160,6 +238,7 @@ void Application::sensorThreadMain()
             success=sensor->readFrame(rawFrame);
             if(success==false) puts("Error reading frame");
         } while(success==false);
+        rawFrame->timestamp=getTime();
         {
             FastGlobalIrqLock dLock;
             success=rawFrameQueue.IRQput(rawFrame); //Nonblocking put
@@ -183,6 +262,8 @@ void *Application::processThreadMainTramp(void *p)
 
 void Application::processThreadMain()
 {
+    bool recording=false;
+    long long lastRecorded=0;
     while(ui.lifecycle != UI::Quit)
     {
         MLX90640RawFrame *rawFrame=nullptr;
@@ -191,8 +272,36 @@ void Application::processThreadMain()
         //auto t1=getTime();
         auto *processedFrame=new MLX90640Frame;
         sensor->processFrame(rawFrame,processedFrame,ui.options.emissivity);
+        {
+            Lock<FastMutex> lock(lastStatsMutex);
+            lastStats=processedFrame->stats;
+            lastStatsTime=rawFrame->timestamp;
+        }
+        //Like the UI, keep the frame on screen while paused
+        if(ui.paused==false)
+        {
+            Lock<FastMutex> lock(lastRawMutex);
+            *lastRaw=*rawFrame;
+            lastRawEmissivity=ui.options.emissivity;
+        }
+        //The UI takes ownership of processedFrame, so USB gets a copy
+        MLX90640Frame *usbFrame=nullptr;
+        if(usbDumpRawFrames && usbStreamFormat==UsbStreamFormat::BinaryProcessed)
+            usbFrame=new MLX90640Frame(*processedFrame);
+        //The recorder gets a copy too, every recordInterval seconds
+        int interval=ui.options.recordInterval;
+        if(interval<0)
+        {
+            if(recording) recorder->setRecording(false);
+            recording=false;
+        } else if(recording==false || rawFrame->timestamp-lastRecorded>=interval*1000000000LL) {
+            if(recording==false) recorder->setRecording(true);
+            recorder->record(new MLX90640Frame(*processedFrame),rawFrame->timestamp,!recording);
+            recording=true;
+            lastRecorded=rawFrame->timestamp;
+        }
         processedFrameQueue.put(processedFrame);
-        usbOutputQueue.put(rawFrame);
+        usbOutputQueue.put({rawFrame,usbFrame});
         //auto t2=getTime();
         //iprintf("process = %lld\n",t2-t1);
     }
@@ -237,13 +346,56 @@ char *hexDump(const uint8_t *bytes, int size, char *output)
 
 void Application::usbThreadMain()
 {
+    //Replies to ID-tagged commands are queued and sent in a single transfer
+    //when no more commands are pending, so pipelined commands don't cost a
+    //USB round trip each
+    char replies[384];
+    int queued = 0;
+    auto flushReplies = [&]() {
+        if (queued > 0)
+            usb->write(reinterpret_cast<uint8_t *>(replies), queued, usbWriteTimeout);
+        queued = 0;
+    };
     while (ui.lifecycle != UI::Quit) {
-        char buf[80];
-        bool success = usb->readLine(buf, 80);
+        char buf[128];
+        bool success = usb->readLine(buf, sizeof(buf));
         if (!success)
             continue;
-        
-        if (strcmp(buf, "get_eeprom") == 0) {
+
+        if (isdigit(buf[0])) {
+            char reply[192];
+            remoteCommand(buf, reply, sizeof(reply));
+            int len = strlen(reply);
+            if (queued + len > static_cast<int>(sizeof(replies))) flushReplies();
+            memcpy(replies + queued, reply, len);
+            queued += len;
+            if (!usb->waitForInput(0)) flushReplies();
+            continue;
+        }
+        //Untagged commands reply directly, after the queued replies
+        flushReplies();
+        //Only the binary stream, credit and download commands use arguments
+        char *arg = strchr(buf, ' ');
+        if (arg) *arg++ = '\0';
+        int value = arg ? atoi(arg) : -1;
+        if (strcmp(buf, "download") == 0) {
+            //Unlike the other arguments, the offset can be 0
+            unsigned int offset = 0, size = Flash::instance().size();
+            char *end = arg;
+            if (arg && isdigit(*end)) offset = strtoul(end, &end, 0);
+            if (arg && *end == ' ' && isdigit(end[1])) size = strtoul(end + 1, &end, 0);
+            if (arg && (end == arg || *end != '\0')) {
+                usb->print("Unrecognized command\r\n", usbWriteTimeout);
+            } else {
+                usbDumpRawFrames = false;
+                usb->print("binary\r\n", usbWriteTimeout);
+                usbDownload(offset, size);
+            }
+        } else if (arg && value <= 0) {
+            usb->print("Unrecognized command\r\n", usbWriteTimeout);
+        } else if (buf[0] == '\0') {
+            //Empty line, such as the \n of a \r\n line ending
+        } else if (strcmp(buf, "get_eeprom") == 0) {
             const MLX90640EEPROM& eeprom = sensor->getEEPROM();
             const int hexSize = MLX90640EEPROM::eepromSize*4+2;
             char *hex = new char[hexSize];
@@ -252,9 +404,37 @@ void Application::usbThreadMain()
             usb->write(reinterpret_cast<uint8_t *>(hex), hexSize, usbWriteTimeout);
             delete[] hex;
         } else if (strcmp(buf, "start_stream") == 0) {
+            usbCredit = -1;
+            usbStreamFormat = UsbStreamFormat::Hex;
+            usbDumpRawFrames = true;
+        } else if (strcmp(buf, "start_stream_binary") == 0 ||
+                   strcmp(buf, "start_stream_processed") == 0 ||
+                   strcmp(buf, "start_stream_binary_compressed") == 0 ||
+                   strcmp(buf, "start_stream_processed_compressed") == 0) {
+            //Reply before the first packet, so the host knows the format
+            usbDumpRawFrames = false;
+            usb->print("binary\r\n", usbWriteTimeout);
+            usbStreamFormat = strncmp(buf, "start_stream_binary", 19) == 0 ?
+                UsbStreamFormat::BinaryRaw : UsbStreamFormat::BinaryProcessed;
+            usbCompress = strstr(buf, "_compressed") != nullptr;
+            usbForceKeyframe = true;
+            usbCredit = value;
             usbDumpRawFrames = true;
         } else if (strcmp(buf, "stop_stream") == 0) {
             usbDumpRawFrames = false;
+            usbCredit = -1;
+            usbBulk = false;
+        } else if (strcmp(buf, "stream_to_bulk") == 0) {
+            usbBulk = usb->bulkConnected();
+            usb->print(usbBulk ? "bulk\r\n" : "Bulk interface not configured\r\n",
+                       usbWriteTimeout);
+        } else if (strcmp(buf, "credit") == 0) {
+            //No reply, as it is sent while packets are being received
+            if (value > 0 && usbCredit >= 0) usbCredit += value;
+        } else if (strcmp(buf, "test_stream") == 0 && value > 0) {
+            usbDumpRawFrames = false;
+            usb->print("binary\r\n", usbWriteTimeout);
+            usbTestStream(value);
         } else {
             usb->print("Unrecognized command\r\n", usbWriteTimeout);
         }
@@ -263,6 +443,410 @@ void Application::usbThreadMain()
             MemoryProfiling::getAbsoluteFreeStack());
 }
 
+/**
+ * Append formatted text to a reply line, truncating it if it does not fit
+ */
+static void appendReply(char *reply, int size, const char *fmt, ...)
+{
+    int len = strlen(reply);
+    va_list arg;
+    va_start(arg, fmt);
+    vsniprintf(reply + len, size - len, fmt, arg);
+    va_end(arg);
+}
+
+/**
+ * A value formatted with two decimals, without pulling float support into
+ * printf
+ */
+struct Decimal
+{
+    char s[16];
+};
+
+/**
+ * \param value fixed point value
+ * \param scale value of 1 in fixed point, such as MLX90640Frame::scaleFactor
+ * \return the value formatted with two decimals, rounded
+ */
+static Decimal decimal(int value, int scale)
+{
+    Decimal result;
+    int hundredths = (abs(value) * 100 + scale / 2) / scale;
+    sniprintf(result.s, sizeof(result.s), "%s%d.%02d", value < 0 ? "-" : "",
+              hundredths / 100, hundredths % 100);
+    return result;
+}
+
+/**
+ * \return an emissivity formatted with two decimals
+ */
+static Decimal decimal(float emissivity)
+{
+    return decimal(static_cast<int>(emissivity * 100.f + 0.5f), 100);
+}
+
+static bool parseInt(const char *value, int minValue, int maxValue, int& result)
+{
+    char *end;
+    long v = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || v < minValue || v > maxValue)
+        return false;
+    result = v;
+    return true;
+}
+
+/// Names of the options of the get and set commands, in get reply order
+static const char * const remoteOptions[] = {
+    "emissivity", "framerate", "brightness", "palette", "zoom", "panx", "pany",
+    "histeq", "range", "isotherm", "threshold", "spotmarkers", "record"
+};
+
+static const char * const rangeNames[] = { "auto", "smooth", "locked" };
+static const char * const isothermNames[] = { "off", "above", "below" };
+
+static bool formatOption(const char *name, const ApplicationOptions& o,
+                         char *reply, int size)
+{
+    if (strcmp(name, "emissivity") == 0)
+        appendReply(reply, size, " emissivity=%s", decimal(o.emissivity).s);
+    else if (strcmp(name, "framerate") == 0)
+        appendReply(reply, size, " framerate=%d", o.frameRate);
+    else if (strcmp(name, "brightness") == 0)
+        appendReply(reply, size, " brightness=%d", o.brightness);
+    else if (strcmp(name, "palette") == 0)
+        appendReply(reply, size, " palette=%d", static_cast<int>(o.colormap));
+    else if (strcmp(name, "zoom") == 0)
+        appendReply(reply, size, " zoom=%d", o.zoom);
+    else if (strcmp(name, "panx") == 0)
+        appendReply(reply, size, " panx=%d", o.panX);
+    else if (strcmp(name, "pany") == 0)
+        appendReply(reply, size, " pany=%d", o.panY);
+    else if (strcmp(name, "histeq") == 0)
+        appendReply(reply, size, " histeq=%d", o.histEqualization ? 1 : 0);
+    else if (strcmp(name, "range") == 0)
+        appendReply(reply, size, " range=%s",
+                    rangeNames[static_cast<int>(o.rangeMode)]);
+    else if (strcmp(name, "isotherm") == 0)
+        appendReply(reply, size, " isotherm=%s",
+                    isothermNames[static_cast<int>(o.isotherm)]);
+    else if (strcmp(name, "threshold") == 0)
+        appendReply(reply, size, " threshold=%d", o.isothermTemp);
+    else if (strcmp(name, "spotmarkers") == 0)
+        appendReply(reply, size, " spotmarkers=%d", o.spotMarkers ? 1 : 0);
+    else if (strcmp(name, "record") == 0 && o.recordInterval < 0)
+        appendReply(reply, size, " record=off");
+    else if (strcmp(name, "record") == 0)
+        appendReply(reply, size, " record=%d", o.recordInterval);
+    else return false;
+    return true;
+}
+
+/**
+ * Parse an option value, accepting the same values as the menu
+ * \return false if the option name or value is not valid
+ */
+static bool parseOption(const char *name, const char *value, ApplicationOptions& o)
+{
+    int v;
+    if (strcmp(name, "emissivity") == 0) {
+        char *end;
+        float e = strtof(value, &end);
+        if (end == value || *end != '\0' || e < 0.01f || e > 1.f) return false;
+        o.emissivity = e;
+    } else if (strcmp(name, "framerate") == 0) {
+        if (!parseInt(value, 1, 16, v) || (v & (v - 1)) != 0) return false;
+        o.frameRate = v;
+    } else if (strcmp(name, "brightness") == 0) {
+        if (!parseInt(value, 0, 15, v)) return false;
+        o.brightness = v;
+    } else if (strcmp(name, "palette") == 0) {
+        if (!parseInt(value, 0, numColormaps - 1, v)) return false;
+        o.colormap = static_cast<Colormap>(v);
+    } else if (strcmp(name, "zoom") == 0) {
+        if (!parseInt(value, 1, 8, v) || (v & (v - 1)) != 0) return false;
+        o.zoom = v;
+    } else if (strcmp(name, "panx") == 0) {
+        if (!parseInt(value, 0, MLX90640Frame::nx - 1, v)) return false;
+        o.panX = v;
+    } else if (strcmp(name, "pany") == 0) {
+        if (!parseInt(value, 0, MLX90640Frame::ny - 1, v)) return false;
+        o.panY = v;
+    } else if (strcmp(name, "histeq") == 0) {
+        if (!parseInt(value, 0, 1, v)) return false;
+        o.histEqualization = v;
+    } else if (strcmp(name, "range") == 0) {
+        for (v = 0; v < 3; v++) if (strcmp(value, rangeNames[v]) == 0) break;
+        if (v == 3) return false;
+        o.rangeMode = static_cast<RangeMode>(v);
+    } else if (strcmp(name, "isotherm") == 0) {
+        for (v = 0; v < 3; v++) if (strcmp(value, isothermNames[v]) == 0) break;
+        if (v == 3) return false;
+        o.isotherm = static_cast<IsothermMode>(v);
+    } else if (strcmp(name, "threshold") == 0) {
+        if (!parseInt(value, -20, 250, v)) return false;
+        o.isothermTemp = v;
+    } else if (strcmp(name, "spotmarkers") == 0) {
+        if (!parseInt(value, 0, 1, v)) return false;
+        o.spotMarkers = v;
+    } else if (strcmp(name, "record") == 0) {
+        //Any interval, not only those of the menu
+        if (strcmp(value, "off") == 0) v = -1;
+        else if (!parseInt(value, 0, 24*3600, v)) return false;
+        o.recordInterval = v;
+    } else return false;
+    return true;
+}
+
+/*
+ * Remote control commands are lines made of a numeric ID chosen by the host,
+ * a command and its arguments, separated by spaces. Each command gets exactly
+ * one reply line starting with the same ID, either "<id> ok" followed by
+ * space separated key=value pairs, or "<id> error <reason>". Commands are
+ * executed in order, so several of them can be sent without waiting for the
+ * replies. The commands are:
+ * get [option]...            reply with the given options, or all of them
+ * set <option> <value>...    change options, all or none of them
+ * pause, resume              freeze or unfreeze the image
+ * stats                      statistics of the last frame, in °C
+ * battery                    battery voltage and estimated runtime
+ * recorder                   frames recorded and dropped since boot, FLASH
+ *                            sectors used and available, recording session
+ * snapshot                   store the frame on screen as a snapshot
+ * snapshots [index]          number of snapshots and how many fit, or the
+ *                            capture time, emissivity and FLASH address and
+ *                            size of the raw frame of a snapshot
+ * clear_snapshots            delete all snapshots
+ * save                       store the current options in flash
+ * defaults                   restore the default options, without saving them
+ * Options are those in remoteOptions. Temperatures are in °C, palette is the
+ * colormap index in the menu order, and zoom, panx and pany select the region
+ * of the image shown on screen. record is the recording interval in seconds,
+ * 0 to record every frame, or off. Snapshot times are in milliseconds since
+ * the boot they were captured in, and the raw frame can be read with the
+ * download command.
+ */
+void Application::remoteCommand(char *line, char *reply, int size)
+{
+    char *saveptr;
+    const char *id = strtok_r(line, " ", &saveptr);
+    const char *cmd = strtok_r(nullptr, " ", &saveptr);
+    auto nextArg = [&]() -> const char* { return strtok_r(nullptr, " ", &saveptr); };
+    sniprintf(reply, size, "%s ok", id);
+    const char *error = nullptr;
+    if (cmd == nullptr) {
+        error = "missing_command";
+    } else if (strcmp(cmd, "get") == 0) {
+        ApplicationOptions options = ui.getOptions();
+        const char *name = nextArg();
+        if (name == nullptr) {
+            for (auto *n : remoteOptions) formatOption(n, options, reply, size);
+            appendReply(reply, size, " paused=%d", ui.paused ? 1 : 0);
+        }
+        for (; name != nullptr && error == nullptr; name = nextArg())
+            if (!formatOption(name, options, reply, size)) error = "unknown_option";
+    } else if (strcmp(cmd, "set") == 0) {
+        ApplicationOptions options = ui.getOptions();
+        const char *name = nextArg();
+        if (name == nullptr) error = "missing_argument";
+        for (; name != nullptr && error == nullptr; name = nextArg()) {
+            const char *value = nextArg();
+            if (value == nullptr) error = "missing_argument";
+            else if (!parseOption(name, value, options)) error = "bad_value";
+        }
+        if (error == nullptr) ui.setOptions(options);
+    } else if (strcmp(cmd, "pause") == 0 || strcmp(cmd, "resume") == 0) {
+        ui.setPaused(strcmp(cmd, "pause") == 0);
+    } else if (strcmp(cmd, "stats") == 0) {
+        MLX90640FrameStats stats;
+        long long time;
+        {
+            Lock<FastMutex> lock(lastStatsMutex);
+            stats = lastStats;
+            time = lastStatsTime;
+        }
+        const int scale = MLX90640Frame::scaleFactor;
+        if (time == 0) error = "no_frame";
+        else appendReply(reply, size, " min=%s max=%s mean=%s crosshair=%s"
+                         " argmin=%u argmax=%u time=%lld",
+                         decimal(stats.minTemp, scale).s, decimal(stats.maxTemp, scale).s,
+                         decimal(stats.meanTemp, scale).s,
+                         decimal(stats.crosshairTemp, scale).s,
+                         stats.argMin, stats.argMax, time);
+    } else if (strcmp(cmd, "battery") == 0) {
+        appendReply(reply, size, " millivolts=%d runtime=%d",
+                    battery.millivolts(), battery.runtimeMinutes());
+    } else if (strcmp(cmd, "recorder") == 0) {
+        FrameRecorder::Status s = recorder->status();
+        appendReply(reply, size, " frames=%d dropped=%d sectors=%d total=%d session=%d",
+                    s.frames, s.dropped, s.sectors, s.totalSectors, s.session);
+    } else if (strcmp(cmd, "snapshot") == 0) {
+        int index = captureSnapshot();
+        if (index < 0) error = "not_saved";
+        else appendReply(reply, size, " index=%d", index);
+    } else if (strcmp(cmd, "snapshots") == 0) {
+        const char *arg = nextArg();
+        int index;
+        SnapshotStore::Info info;
+        if (arg == nullptr) {
+            appendReply(reply, size, " count=%d total=%d",
+                        snapshots->count(), snapshotSlots);
+        } else if (!parseInt(arg, 0, snapshotSlots - 1, index) ||
+                   index >= snapshots->count()) {
+            error = "bad_index";
+        } else if (!snapshots->read(index, nullptr, info)) {
+            error = "damaged";
+        } else {
+            appendReply(reply, size, " index=%d time=%u emissivity=%s"
+                        " address=0x%x size=%d", index,
+                        static_cast<unsigned>(info.timestamp),
+                        decimal(info.emissivity).s,
+                        static_cast<unsigned>(snapshotDataAddress(index)),
+                        snapshotDataSize);
+        }
+    } else if (strcmp(cmd, "clear_snapshots") == 0) {
+        snapshots->clear();
+    } else if (strcmp(cmd, "save") == 0) {
+        ApplicationOptions options = ui.getOptions();
+        saveOptions(options);
+    } else if (strcmp(cmd, "defaults") == 0) {
+        ui.setOptions(ApplicationOptions());
+    } else {
+        error = "unknown_command";
+    }
+    if (error) sniprintf(reply, size, "%s error %s", id, error);
+    //Truncate if needed, but always terminate the line
+    int len = min<int>(strlen(reply), size - 3);
+    strcpy(reply + len, "\r\n");
+}
+
+bool Application::writePacket(const USBSegment *segments, int count)
+{
+    if (usbBulk) return usb->writeBulk(segments, count, usbWriteTimeout);
+    return usb->write(segments, count, usbWriteTimeout);
+}
+
+void Application::usbTestStream(int packets)
+{
+    //Same size and write path as uncompressed raw frames, without a sensor
+    const int payloadSize = 2*834*sizeof(uint16_t);
+    std::unique_ptr<uint8_t[]> payload(new uint8_t[payloadSize]());
+    for (int i = 0; i < packets; i++) {
+        UsbPacketHeader header;
+        header.sync = usbPacketSync;
+        header.type = static_cast<uint8_t>(UsbPacketType::Test);
+        header.flags = 0;
+        header.length = payloadSize;
+        header.skipped = 0;
+        header.sequence = i;
+        header.timestamp = getTime();
+        uint16_t crc = crc16Update(crc16Init, &header, sizeof(header));
+        crc = crc16Update(crc, payload.get(), payloadSize);
+        USBSegment segments[] = {
+            { &header, sizeof(header) },
+            { payload.get(), payloadSize },
+            { &crc, sizeof(crc) }
+        };
+        if (!writePacket(segments, 3)) break;
+    }
+}
+
+/**
+ * Chunk of FLASH read while the previous one is written to USB
+ */
+struct DownloadChunk
+{
+    uint32_t addr; ///< Sent before the data, as in the FlashData payload
+    uint8_t data[usbDownloadChunkSize];
+};
+
+/**
+ * State shared by the USB thread and the FLASH reader thread of a download.
+ * Both chunks start in the empty queue. The reader fills them in address
+ * order, the USB thread sends them and returns them. A nullptr in either
+ * queue stops the download
+ */
+struct DownloadState
+{
+    unsigned int addr, end;
+    Queue<DownloadChunk*, 2> empty, full;
+};
+
+static void *downloadReaderThreadMain(void *p)
+{
+    auto *state = static_cast<DownloadState *>(p);
+    auto& flash = Flash::instance();
+    while (state->addr < state->end) {
+        DownloadChunk *chunk;
+        state->empty.get(chunk);
+        if (chunk == nullptr) break;
+        int size = min<unsigned int>(usbDownloadChunkSize, state->end - state->addr);
+        chunk->addr = state->addr;
+        if (!flash.read(state->addr, chunk->data, size)) {
+            iprintf("Failed to read address 0x%x\n", state->addr);
+            break;
+        }
+        state->full.put(chunk);
+        state->addr += size;
+    }
+    state->full.put(nullptr);
+    return nullptr;
+}
+
+void Application::usbDownload(unsigned int offset, unsigned int size)
+{
+    //Double buffering, so the DMA read of a chunk overlaps the USB transfer
+    //of the previous one
+    DownloadState state;
+    state.addr = min(offset, Flash::instance().size());
+    state.end = state.addr + min(size, Flash::instance().size() - state.addr);
+    std::unique_ptr<DownloadChunk[]> chunks(new DownloadChunk[2]);
+    state.empty.put(&chunks[0]);
+    state.empty.put(&chunks[1]);
+    Thread *reader = Thread::create(downloadReaderThreadMain, 2048U, Priority(),
+                                    static_cast<void*>(&state), Thread::JOINABLE);
+    if (reader == nullptr) state.full.put(nullptr);
+
+    uint32_t sequence = 0;
+    uint32_t sent = state.addr; //Where the download stopped, if it fails
+    bool success = true;
+    for (;;) {
+        DownloadChunk *chunk;
+        state.full.get(chunk);
+        if (chunk == nullptr) break;
+        int size = min<unsigned int>(usbDownloadChunkSize, state.end - chunk->addr);
+        if (success) success = writeFlashData(sequence++, chunk->addr, chunk->data, size);
+        if (success) sent = chunk->addr + size;
+        //On failure stop the reader, then wait for its last chunk
+        state.empty.put(success ? chunk : nullptr);
+    }
+    if (reader) reader->join();
+    writeFlashData(sequence, sent, nullptr, 0);
+}
+
+bool Application::writeFlashData(uint32_t sequence, uint32_t addr,
+                                 const uint8_t *data, int size)
+{
+    UsbPacketHeader header;
+    header.sync = usbPacketSync;
+    header.type = static_cast<uint8_t>(UsbPacketType::FlashData);
+    header.flags = 0;
+    header.length = sizeof(addr) + size;
+    header.skipped = 0;
+    header.sequence = sequence;
+    header.timestamp = getTime();
+    uint16_t crc = crc16Update(crc16Init, &header, sizeof(header));
+    crc = crc16Update(crc, &addr, sizeof(addr));
+    crc = crc16Update(crc, data, size);
+    USBSegment segments[] = {
+        { &header, sizeof(header) },
+        { &addr, sizeof(addr) },
+        { data, size },
+        { &crc, sizeof(crc) }
+    };
+    return writePacket(segments, 4);
+}
+
 void *Application::usbFrameOutputThreadMainTramp(void *p)
 {
     static_cast<Application *>(p)->usbFrameOutputThreadMain();
@@ -271,23 +855,127 @@ void *Application::usbFrameOutputThreadMainTramp(void *p)
 
 void Application::usbFrameOutputThreadMain()
 {
+    //Binary packets are sent as segments straight from the frames, only the
+    //hex format and compressed payloads need a buffer, allocated on first use
     const int hexSize = (2+834*sizeof(uint16_t)*2+2)*2;
-    char *hex = new char[hexSize];
+    std::unique_ptr<char[]> hex;
+    std::unique_ptr<uint8_t[]> encoded;
+    static_assert(FrameEncoder::maxEncodedSize(2*834) <= usbMaxPayloadSize,
+                  "Compressed frame does not fit in buffer");
+    static_assert(sizeof(UsbFrameStats::histogram)
+                  == sizeof(MLX90640FrameStats::histogram), "Histogram mismatch");
+    uint32_t sequence = 0;
+    int skipped = 0; //Frames not sent since the last packet
+    //A keyframe every 16 frames bounds the frames lost after a USB error.
+    //The encoders keep the previous frame on the heap, not on the stack
+    const int keyframeInterval = 16;
+    FrameEncoder rawEncoder(2*834, keyframeInterval);
+    FrameEncoder processedEncoder(32*24, keyframeInterval);
 
     while(ui.lifecycle != UI::Quit)
     {
         std::unique_ptr<MLX90640RawFrame> rawFrame;
+        std::unique_ptr<MLX90640Frame> processedFrame;
         {
-            MLX90640RawFrame *pointer=nullptr;
-            usbOutputQueue.get(pointer);
-            rawFrame.reset(pointer);
+            UsbOutputFrame frame;
+            usbOutputQueue.get(frame);
+            rawFrame.reset(frame.raw);
+            processedFrame.reset(frame.processed);
         }
         if (!rawFrame) continue;
         if (!usb->connected())
         {
             usbDumpRawFrames = false;
-        } else if (usbDumpRawFrames && !ui.paused) {
-            char *p = hex;
+            usbCredit = -1;
+            usbBulk = false;
+        } else if (usbDumpRawFrames && !ui.paused && usbStreamFormat != UsbStreamFormat::Hex) {
+            //Format changed after the frame was processed, skip it
+            bool missing = usbStreamFormat == UsbStreamFormat::BinaryProcessed
+                        && !processedFrame;
+            //Take one credit, if flow control is enabled
+            int credit = usbCredit;
+            if (!missing)
+                while (credit > 0 && !usbCredit.compare_exchange_weak(credit, credit - 1)) {}
+            if (missing || credit == 0) {
+                skipped++;
+                continue;
+            }
+            if (usbForceKeyframe) {
+                usbForceKeyframe = false;
+                rawEncoder.forceKeyframe();
+                processedEncoder.forceKeyframe();
+            }
+            bool compressed = usbCompress;
+            if (compressed && !encoded) encoded.reset(new uint8_t[usbMaxPayloadSize]);
+            UsbPacketHeader header;
+            header.sync = usbPacketSync;
+            header.flags = compressed ? usbPacketCompressed : 0;
+            header.skipped = min(skipped, 0xffff);
+            header.sequence = sequence;
+            header.timestamp = rawFrame->timestamp;
+            UsbFrameStats stats;
+            //Header, up to two payload segments and the CRC
+            USBSegment segments[4];
+            int count = 0;
+            segments[count++] = { &header, sizeof(header) };
+            if (usbStreamFormat == UsbStreamFormat::BinaryRaw) {
+                header.type = static_cast<uint8_t>(UsbPacketType::RawFrame);
+                if (compressed) {
+                    bool keyframe;
+                    int size = rawEncoder.encode(&rawFrame->subframe[0][0],
+                                                 encoded.get(), keyframe);
+                    if (keyframe) header.flags |= usbPacketKeyframe;
+                    segments[count++] = { encoded.get(), size };
+                } else {
+                    segments[count++] = { rawFrame->subframe, sizeof(rawFrame->subframe) };
+                }
+            } else {
+                header.type = static_cast<uint8_t>(UsbPacketType::ProcessedFrame);
+                const MLX90640FrameStats& s = processedFrame->stats;
+                stats.minTemp = s.minTemp;
+                stats.maxTemp = s.maxTemp;
+                stats.meanTemp = s.meanTemp;
+                stats.crosshairTemp = s.crosshairTemp;
+                stats.argMin = s.argMin;
+                stats.argMax = s.argMax;
+                stats.scaleFactor = MLX90640Frame::scaleFactor;
+                memcpy(stats.histogram, s.histogram, sizeof(stats.histogram));
+                segments[count++] = { &stats, sizeof(stats) };
+                if (compressed) {
+                    bool keyframe;
+                    auto *temperature = reinterpret_cast<const uint16_t *>(processedFrame->temperature);
+                    int size = processedEncoder.encode(temperature, encoded.get(), keyframe);
+                    if (keyframe) header.flags |= usbPacketKeyframe;
+                    segments[count++] = { encoded.get(), size };
+                } else {
+                    segments[count++] = { processedFrame->temperature,
+                                          sizeof(processedFrame->temperature) };
+                }
+            }
+            header.length = 0;
+            for (int i = 1; i < count; i++) header.length += segments[i].size;
+            uint16_t crc = crc16Init;
+            for (int i = 0; i < count; i++)
+                crc = crc16Update(crc, segments[i].buf, segments[i].size);
+            segments[count++] = { &crc, sizeof(crc) };
+            //The frames are released only after the write, as it reads them.
+            //If the packet is not sent the host can't decode the next delta
+            //frame, and the frame counts as skipped. The credit is given
+            //back, as the host only notices lost packets from the sequence
+            if (writePacket(segments, count)) {
+                sequence++;
+                skipped = 0;
+            } else {
+                usbForceKeyframe = true;
+                skipped++;
+                credit = usbCredit;
+                while (credit >= 0 && !usbCredit.compare_exchange_weak(credit, credit + 1)) {}
+            }
+        } else if (!usbDumpRawFrames) {
+            skipped = 0;
+        } else if (!ui.paused) {
+            if (!hex) hex.reset(new char[hexSize]);
+            char *p = hex.get();
             *p++ = '1'; *p++ = '=';
             p = hexDump(reinterpret_cast<const uint8_t *>(rawFrame->subframe[0]), 834*2, p);
             *p++ = '\r'; *p++ = '\n';
@@ -295,10 +983,9 @@ void Application::usbFrameOutputThreadMain()
             p = hexDump(reinterpret_cast<const uint8_t *>(rawFrame->subframe[1]), 834*2, p);
             *p++ = '\r'; *p++ = '\n';
             rawFrame.reset(nullptr);
-            usb->write(reinterpret_cast<uint8_t *>(hex), hexSize, usbWriteTimeout);
+            usb->write(reinterpret_cast<uint8_t *>(hex.get()), hexSize, usbWriteTimeout);
         }
     }
-    delete[] hex;
 
     iprintf("usbOutputThread min free stack %d\n",
             MemoryProfiling::getAbsoluteFreeStack());
@@ -28,14 +28,28 @@
 #pragma once
 
 #include <memory>
+#include <atomic>
 #include <miosix.h>
 #include <mxgui/display.h>
 #include <drivers/stm32f2_f4_i2c.h>
 #include <drivers/mlx90640.h>
 #include <drivers/hwmapping.h>
 #include <drivers/usb_tinyusb.h>
+#include <drivers/frame_recorder.h>
+#include <drivers/snapshot_store.h>
 #include "renderer.h"
 #include "applicationui.h"
+#include "battery_monitor.h"
+
+/**
+ * Frame passed to the USB output thread. The processed frame is only present
+ * when streaming processed frames
+ */
+struct UsbOutputFrame
+{
+    MLX90640RawFrame *raw;
+    MLX90640Frame *processed;
+};
 
 /**
  * Main application class. Decorates ApplicationUI with hardware I/O code.
@@ -57,6 +71,12 @@ public:
     void setPause(bool pause);
 
     void saveOptions(ApplicationOptions& options);
+
+    int captureSnapshot();
+
+    int snapshotCount();
+
+    bool loadSnapshot(int index, MLX90640Frame *frame, float& emissivity);
     
 private:
     Application(const Application&)=delete;
@@ -79,17 +99,41 @@ private:
     static void *usbFrameOutputThreadMainTramp(void *p);
     inline void usbFrameOutputThreadMain();
 
+    void remoteCommand(char *line, char *reply, int size);
+
+    bool writePacket(const USBSegment *segments, int count);
+
+    void usbTestStream(int packets);
+
+    void usbDownload(unsigned int offset, unsigned int size);
+
+    bool writeFlashData(uint32_t sequence, uint32_t addr, const uint8_t *data, int size);
+
     miosix::Thread *sensorThread;
     mxgui::Display& display;
     UI ui;
-    int prevBatteryVoltage=42; //4.2V
+    BatteryMonitor battery;
     std::unique_ptr<miosix::I2C1Master> i2c;
     std::unique_ptr<MLX90640> sensor;
     std::unique_ptr<USBCDC> usb;
+    std::unique_ptr<FrameRecorder> recorder;
+    std::unique_ptr<SnapshotStore> snapshots;
     miosix::Queue<MLX90640RawFrame*, 1> rawFrameQueue;
     miosix::Queue<MLX90640Frame*, 1> processedFrameQueue;
     volatile bool usbDumpRawFrames=false;
-    miosix::Queue<MLX90640RawFrame*, 1> usbOutputQueue;
+    enum class UsbStreamFormat { Hex, BinaryRaw, BinaryProcessed };
+    volatile UsbStreamFormat usbStreamFormat=UsbStreamFormat::Hex;
+    volatile bool usbCompress=false;      ///< Binary frames sent compressed
+    volatile bool usbForceKeyframe=false; ///< Stream restarted, host has no frame
+    std::atomic<int> usbCredit{-1};       ///< Frames the host can receive, -1 if unlimited
+    volatile bool usbBulk=false;          ///< Packets sent on the vendor interface
+    miosix::Queue<UsbOutputFrame, 1> usbOutputQueue;
+    miosix::FastMutex lastStatsMutex;
+    MLX90640FrameStats lastStats;  ///< Of the last processed frame
+    long long lastStatsTime=0;     ///< Timestamp of lastStats, 0 if none yet
+    miosix::FastMutex lastRawMutex;
+    std::unique_ptr<MLX90640RawFrame> lastRaw; ///< On screen, for snapshots
+    float lastRawEmissivity;                   ///< lastRaw was processed with
 
     const unsigned long long usbWriteTimeout = 50ULL * 1000000ULL; // 50ms
 };
@@ -28,6 +28,7 @@
 #pragma once
 
 #include "renderer.h"
+#include "glyph_cache.h"
 #include "edge_detector.h"
 #include "textbox.h"
 #include "version.h"
@@ -48,6 +49,8 @@
 #include <mxgui/display.h>
 #include <memory>
 #include <mutex>
+#include <climits>
+#include <cstring>
 
 #ifndef _MIOSIX
 #define sniprintf snprintf
@@ -66,8 +69,22 @@ struct ApplicationOptions
     int frameRate=8; //NOTE: to get beyond 8fps the I2C bus needs to be overclocked too!
     float emissivity=0.95f;
     int brightness=15;
+    bool histEqualization=false;
+    RangeMode rangeMode=RangeMode::Auto;
+    Colormap colormap=Colormap::Thermal;
+    int zoom=1;
+    int panX=MLX90640Frame::nx/2, panY=MLX90640Frame::ny/2;
+    IsothermMode isotherm=IsothermMode::Off;
+    int isothermTemp=60;
+    bool spotMarkers=false;
+    int recordInterval=-1; ///< Seconds between recorded frames, 0 all, -1 off
 };
 
+/// Options record type and schema version, see options_save.h. Fields can be
+/// appended to ApplicationOptions without changing the version
+const int applicationOptionsType=0;
+const int applicationOptionsVersion=1;
+
 class IOHandlerBase
 {
 public:
@@ -80,6 +97,26 @@ public:
     void setPause(bool pause);
 
     void saveOptions(ApplicationOptions& options);
+
+    /**
+     * Store the frame on screen as a snapshot, without blocking
+     * \return the snapshot index, or -1 if it could not be stored
+     */
+    int captureSnapshot();
+
+    /**
+     * \return the number of snapshots stored
+     */
+    int snapshotCount();
+
+    /**
+     * Load and process a snapshot
+     * \param index snapshot index, from 0 to snapshotCount()-1
+     * \param frame the processed snapshot is stored here
+     * \param emissivity the emissivity of the snapshot is stored here
+     * \return false if the snapshot is damaged
+     */
+    bool loadSnapshot(int index, MLX90640Frame *frame, float& emissivity);
 };
 
 /**
@@ -99,10 +136,54 @@ public:
         enterBootMessage(dc);
     }
 
+    /**
+     * Update the whole UI: buttons and status indicators
+     */
     void update();
 
+    /**
+     * Sample the buttons and process their events. Call when a button changes
+     * state, and periodically while a button is pressed, as long press and
+     * autorepeat events are time-based
+     */
+    void updateButtons();
+
+    /**
+     * \return true if at least one button is pressed
+     */
+    bool buttonsPressed() { return upBtn.getValue() || onBtn.getValue(); }
+
+    /**
+     * Sample the USB connection state, redrawing its indicator if it changed
+     */
+    void updateUSB();
+
+    /**
+     * Sample the battery level, redrawing its icon if it changed
+     */
+    void updateBattery();
+
     void updateFrame(MLX90640Frame *processedFrame);
 
+    /**
+     * \return a copy of the current options, consistent even if they are
+     * being changed from the menu
+     */
+    ApplicationOptions getOptions();
+
+    /**
+     * Change the options from a thread other than the UI one, redrawing the
+     * menu if it is open. Like changes from the menu, they are not saved
+     * \param newOptions new options
+     */
+    void setOptions(const ApplicationOptions& newOptions);
+
+    /**
+     * Pause or resume the image from a thread other than the UI one
+     * \param pause true to pause
+     */
+    void setPaused(bool pause);
+
     enum Lifecycle
     {
         Boot,
@@ -125,14 +206,22 @@ private:
 
     void drawStaticPartOfMainScreen(mxgui::DrawingContext& dc);
 
+    void drawStatusLine(mxgui::DrawingContext& dc, const char *message=nullptr);
+
     void drawPauseIndicator(mxgui::DrawingContext& dc);
 
+    void applyPause(mxgui::DrawingContext& dc, bool pause);
+
     void drawUSBConnectionIndicator(mxgui::DrawingContext& dc);
 
+    void drawRecordIndicator(mxgui::DrawingContext& dc);
+
     void enterMain(mxgui::DrawingContext& dc);
 
     void updateMain(mxgui::DrawingContext& dc);
 
+    void takeSnapshot(mxgui::DrawingContext& dc);
+
     void drawStaticPartOfMenuScreen(mxgui::DrawingContext& dc);
 
     void enterMenu(mxgui::DrawingContext& dc);
@@ -143,12 +232,26 @@ private:
 
     void updateMenu(mxgui::DrawingContext& dc);
 
+    void enterGallery(mxgui::DrawingContext& dc);
+
+    void updateGallery(mxgui::DrawingContext& dc);
+
+    void drawSnapshot(mxgui::DrawingContext& dc);
+
     void enterShutdown(mxgui::DrawingContext& dc);
 
     void drawFrame(mxgui::DrawingContext& dc);
 
+    void renderFrame(mxgui::DrawingContext& dc, MLX90640Frame *frame);
+
     void drawTemperature(mxgui::DrawingContext& dc, mxgui::Point a, mxgui::Point b,
-                         mxgui::Font f, short temperature);
+                         GlyphCache& digits, short temperature, short& drawn);
+
+    void invalidateDrawnValues();
+
+    void drawImageBorder(mxgui::DrawingContext& dc, bool alarm);
+
+    bool scrollMenu(mxgui::DrawingContext& dc);
 
     static inline unsigned short to565(unsigned short r, unsigned short g, unsigned short b)
     {
@@ -157,10 +260,13 @@ private:
 
     const mxgui::Font& smallFont = mxgui::tahoma;
     const mxgui::Font& largeFont = mxgui::droid21;
+    GlyphCache smallDigits{smallFont,mxgui::white,mxgui::black};
+    GlyphCache largeDigits{largeFont,mxgui::white,mxgui::black};
 
     mxgui::Display& display;
     std::unique_ptr<ThermalImageRenderer> renderer;
     std::mutex lastFrameMutex;
+    std::mutex uiMutex; ///< Serializes the UI thread and remote changes
     std::shared_ptr<MLX90640Frame> lastFrame;
     IOHandler& ioHandler;
     ButtonEdgeDetector<true> upBtn;
@@ -170,6 +276,7 @@ private:
         BootMsg,
         Main,
         Menu,
+        Gallery,
         Shutdown
     };
     State state = State::BootMsg;
@@ -179,15 +286,48 @@ private:
         Emissivity,
         FrameRate,
         Brightness,
+        Colors,
+        Zoom,
+        PanX,
+        PanY,
+        HistEqualization,
+        Range,
+        Isotherm,
+        Threshold,
+        SpotMarkers,
+        Record,
+        ShowGallery,
         SaveChanges,
         NumEntries
     };
     int menuEntry;
+    int menuScroll; ///< First menu entry visible on screen
+    int galleryIndex, galleryCount; ///< Snapshot shown, and their number
+    float galleryEmissivity;        ///< Of the snapshot shown
+    std::unique_ptr<MLX90640Frame> galleryFrame;
+    int statusMessageFrames = 0; ///< Frames before the status line is restored
+    //Values currently on screen, used to skip redrawing them if unchanged
+    short drawnMinTemp, drawnMaxTemp, drawnCrosshairTemp;
+    bool legendDrawn;
+    bool drawnAlarm;
+    bool indicatorsDrawn;
+    bool drawnUSB;
+    BatteryLevel drawnBattery;
+    mxgui::Color drawnLegend[128];
 };
 
 template<class IOHandler>
 void ApplicationUI<IOHandler>::update()
 {
+    updateButtons();
+    updateUSB();
+    updateBattery();
+}
+
+template<class IOHandler>
+void ApplicationUI<IOHandler>::updateButtons()
+{
+    std::lock_guard<std::mutex> lock(uiMutex);
     mxgui::DrawingContext dc(display);
     ButtonState btns = ioHandler.checkButtons();
     upBtn.update(btns.up);
@@ -196,10 +336,28 @@ void ApplicationUI<IOHandler>::update()
         case BootMsg: updateBootMessage(dc); break;
         case Main: updateMain(dc); break;
         case Menu: updateMenu(dc); break;
+        case Gallery: updateGallery(dc); break;
         case Shutdown:
         default: break;
     }
-    if (state == Main || state == Menu) drawBatteryIcon(dc);
+}
+
+template<class IOHandler>
+void ApplicationUI<IOHandler>::updateUSB()
+{
+    std::lock_guard<std::mutex> lock(uiMutex);
+    if (state != Main && state != Menu) return;
+    mxgui::DrawingContext dc(display);
+    drawUSBConnectionIndicator(dc);
+}
+
+template<class IOHandler>
+void ApplicationUI<IOHandler>::updateBattery()
+{
+    std::lock_guard<std::mutex> lock(uiMutex);
+    if (state != Main && state != Menu && state != Gallery) return;
+    mxgui::DrawingContext dc(display);
+    drawBatteryIcon(dc);
 }
 
 template<class IOHandler>
@@ -218,6 +376,34 @@ void ApplicationUI<IOHandler>::updateFrame(MLX90640Frame *processedFrame)
     }
 }
 
+template<class IOHandler>
+ApplicationOptions ApplicationUI<IOHandler>::getOptions()
+{
+    std::lock_guard<std::mutex> lock(uiMutex);
+    return options;
+}
+
+template<class IOHandler>
+void ApplicationUI<IOHandler>::setOptions(const ApplicationOptions& newOptions)
+{
+    std::lock_guard<std::mutex> lock(uiMutex);
+    mxgui::DrawingContext dc(display);
+    if (newOptions.brightness != options.brightness)
+        display.setBrightness(newOptions.brightness * 6);
+    options = newOptions;
+    if (state == Main || state == Menu) drawRecordIndicator(dc);
+    if (state == Menu)
+        for (int i=0; i<NumEntries; i++) drawMenuEntry(dc, i);
+}
+
+template<class IOHandler>
+void ApplicationUI<IOHandler>::setPaused(bool pause)
+{
+    std::lock_guard<std::mutex> lock(uiMutex);
+    mxgui::DrawingContext dc(display);
+    if (pause != paused) applyPause(dc, pause);
+}
+
 template<class IOHandler>
 void ApplicationUI<IOHandler>::enterBootMessage(mxgui::DrawingContext& dc)
 {
@@ -252,7 +438,10 @@ template<class IOHandler>
 void ApplicationUI<IOHandler>::drawBatteryIcon(mxgui::DrawingContext& dc)
 {
     mxgui::Point batteryIconPoint(104,0);
-    switch(ioHandler.checkBatteryLevel())
+    BatteryLevel level = ioHandler.checkBatteryLevel();
+    if (indicatorsDrawn && level == drawnBattery) return;
+    drawnBattery = level;
+    switch(level)
     {
         case BatteryLevel::B100: dc.drawImage(batteryIconPoint,batt100icon); break;
         case BatteryLevel::B75:  dc.drawImage(batteryIconPoint,batt75icon); break;
@@ -275,21 +464,33 @@ void ApplicationUI<IOHandler>::drawStaticPartOfMainScreen(mxgui::DrawingContext&
     dc.clear(mxgui::black);
     //For mxgui::point coordinates see ui-mockup-main-screen.png
     dc.drawImage(mxgui::Point(0,0),emissivityicon);
-    char line[16];
-    snprintf(line,sizeof(line),"%.2f  %2dfps ",options.emissivity,options.frameRate);
-    dc.setFont(smallFont);
-    dc.setTextColor(std::make_pair(mxgui::white,mxgui::black));
-    dc.write(mxgui::Point(11,0),line);
-    const mxgui::Color darkGrey=to565(128,128,128), lightGrey=to565(192,192,192);
-    dc.line(mxgui::Point(0,12),mxgui::Point(0,107),darkGrey);
-    dc.line(mxgui::Point(1,12),mxgui::Point(127,12),darkGrey);
-    dc.line(mxgui::Point(127,13),mxgui::Point(127,107),lightGrey);
-    dc.line(mxgui::Point(1,107),mxgui::Point(126,107),lightGrey);
+    drawStatusLine(dc);
+    drawImageBorder(dc,false);
     dc.drawImage(mxgui::Point(18,115),smallcelsiusicon);
     dc.drawImage(mxgui::Point(117,115),smallcelsiusicon);
     dc.drawImage(mxgui::Point(72,109),largecelsiusicon);
 }
 
+template<class IOHandler>
+void ApplicationUI<IOHandler>::drawStatusLine(mxgui::DrawingContext& dc, const char *message)
+{
+    //In the main screen the indicators start at x=73, the gallery only has
+    //the battery icon
+    const mxgui::Point p0(11,0);
+    const mxgui::Point p1(state == Gallery ? 103 : 72,11);
+    char line[32];
+    if (message) snprintf(line,sizeof(line),"%s",message);
+    else if (state != Gallery)
+        snprintf(line,sizeof(line),"%.2f  %2dfps",options.emissivity,options.frameRate);
+    else if (galleryFrame)
+        snprintf(line,sizeof(line),"%.2f  %d/%d",galleryEmissivity,galleryIndex+1,galleryCount);
+    else snprintf(line,sizeof(line),"      %d/%d",galleryCount>0 ? galleryIndex+1 : 0,galleryCount);
+    dc.clear(p0,p1,mxgui::black);
+    dc.setFont(smallFont);
+    dc.setTextColor(std::make_pair(mxgui::white,mxgui::black));
+    dc.write(p0,line);
+}
+
 template<class IOHandler>
 void ApplicationUI<IOHandler>::drawPauseIndicator(mxgui::DrawingContext& dc)
 {
@@ -299,22 +500,46 @@ void ApplicationUI<IOHandler>::drawPauseIndicator(mxgui::DrawingContext& dc)
     else dc.clear(p0,p1,mxgui::black);
 }
 
+template<class IOHandler>
+void ApplicationUI<IOHandler>::applyPause(mxgui::DrawingContext& dc, bool pause)
+{
+    paused=pause;
+    ioHandler.setPause(paused);
+    if (state == Main || state == Menu) drawPauseIndicator(dc);
+}
+
 template<class IOHandler>
 void ApplicationUI<IOHandler>::drawUSBConnectionIndicator(mxgui::DrawingContext& dc)
 {
     const mxgui::Point p0(80,1);
     const mxgui::Point p1(80+5,1+10);
-    if (ioHandler.checkUSBConnected()) dc.drawImage(p0,usbicon);
+    bool connected = ioHandler.checkUSBConnected();
+    if (indicatorsDrawn && connected == drawnUSB) return;
+    drawnUSB = connected;
+    if (connected) dc.drawImage(p0,usbicon);
     else dc.clear(p0,p1,mxgui::black);
 }
 
+template<class IOHandler>
+void ApplicationUI<IOHandler>::drawRecordIndicator(mxgui::DrawingContext& dc)
+{
+    const mxgui::Point p0(73,3);
+    const mxgui::Point p1(73+4,3+4);
+    dc.clear(p0,p1,options.recordInterval>=0 ? to565(255,0,0) : mxgui::black);
+}
+
 template<class IOHandler>
 void ApplicationUI<IOHandler>::enterMain(mxgui::DrawingContext& dc)
 {
     state = Main;
+    statusMessageFrames = 0;
+    invalidateDrawnValues();
     drawStaticPartOfMainScreen(dc);
     drawPauseIndicator(dc);
+    drawBatteryIcon(dc);
     drawUSBConnectionIndicator(dc);
+    drawRecordIndicator(dc);
+    indicatorsDrawn = true;
     drawFrame(dc);
     onBtn.ignoreUntilNextPress();
     upBtn.ignoreUntilNextPress();
@@ -323,15 +548,23 @@ void ApplicationUI<IOHandler>::enterMain(mxgui::DrawingContext& dc)
 template<class IOHandler>
 void ApplicationUI<IOHandler>::updateMain(mxgui::DrawingContext& dc)
 {
+    //The menu opens on release, as a long press takes a snapshot
     if(onBtn.getLongPressEvent()) enterShutdown(dc);
-    else if(onBtn.getUpEvent())
-    {
-        paused=!paused;
-        ioHandler.setPause(paused);
-        drawPauseIndicator(dc);
-    }
-    else if(upBtn.getDownEvent()) enterMenu(dc);
-    drawUSBConnectionIndicator(dc);
+    else if(onBtn.getUpEvent()) applyPause(dc, !paused);
+    else if(upBtn.getLongPressEvent()) takeSnapshot(dc);
+    else if(upBtn.getShortPressEvent()) enterMenu(dc);
+}
+
+template<class IOHandler>
+void ApplicationUI<IOHandler>::takeSnapshot(mxgui::DrawingContext& dc)
+{
+    //Shown in the status line for two seconds worth of frames
+    int index = ioHandler.captureSnapshot();
+    char message[24];
+    if (index >= 0) sniprintf(message, sizeof(message), "Saved %d", index+1);
+    else strcpy(message, "Not saved");
+    drawStatusLine(dc, message);
+    statusMessageFrames = 2*options.frameRate;
 }
 
 template<class IOHandler>
@@ -345,21 +578,23 @@ void ApplicationUI<IOHandler>::drawStaticPartOfMenuScreen(mxgui::DrawingContext&
     dc.write(mxgui::Point(66,25),"Tmin");
     dc.drawImage(mxgui::Point(114,13),smallcelsiusicon);
     dc.drawImage(mxgui::Point(114,26),smallcelsiusicon);
-    mxgui::Color darkGrey=to565(128,128,128), lightGrey=to565(192,192,192);
-    dc.line(mxgui::Point(0,0),mxgui::Point(0,48),darkGrey);
-    dc.line(mxgui::Point(1,0),mxgui::Point(64,0),darkGrey);
-    dc.line(mxgui::Point(1,48),mxgui::Point(64,48),lightGrey);
-    dc.line(mxgui::Point(64,1),mxgui::Point(64,47),lightGrey);
+    drawImageBorder(dc,false);
 }
 
 template<class IOHandler>
 void ApplicationUI<IOHandler>::enterMenu(mxgui::DrawingContext& dc)
 {
     state = Menu;
+    statusMessageFrames = 0;
     menuEntry = Back;
+    menuScroll = 0;
+    invalidateDrawnValues();
     drawStaticPartOfMenuScreen(dc);
     drawPauseIndicator(dc);
+    drawBatteryIcon(dc);
     drawUSBConnectionIndicator(dc);
+    drawRecordIndicator(dc);
+    indicatorsDrawn = true;
     drawFrame(dc);
     for (int i=0; i<NumEntries; i++) drawMenuEntry(dc, i);
     upBtn.ignoreUntilNextPress();
@@ -375,7 +610,7 @@ void ApplicationUI<IOHandler>::_drawMenuEntry(mxgui::DrawingContext& dc, int i,
     const mxgui::Color unselectedBGColor = mxgui::black;
     const mxgui::Color unselectedFGColor = mxgui::white;
     const auto fontHeight = dc.getFont().getHeight();
-    short top = 50+i*fontHeight;
+    short top = 50+(i-menuScroll)*fontHeight;
     if (i==menuEntry) dc.setTextColor(std::make_pair(selectedFGColor,selectedBGColor));
     else dc.setTextColor(std::make_pair(unselectedFGColor,unselectedBGColor));
     if (value)
@@ -390,6 +625,8 @@ void ApplicationUI<IOHandler>::_drawMenuEntry(mxgui::DrawingContext& dc, int i,
 template<class IOHandler>
 void ApplicationUI<IOHandler>::drawMenuEntry(mxgui::DrawingContext& dc, int id)
 {
+    const int visibleEntries = (dc.getHeight()-50)/smallFont.getHeight();
+    if (id<menuScroll || id>=menuScroll+visibleEntries) return;
     dc.setFont(smallFont);
     char buffer[8];
     switch (id) {
@@ -406,6 +643,54 @@ void ApplicationUI<IOHandler>::drawMenuEntry(mxgui::DrawingContext& dc, int id)
             sniprintf(buffer, 8, "%d", options.brightness);
             _drawMenuEntry(dc, Brightness, "Brightness", buffer);
             break;
+        case Colors:
+            _drawMenuEntry(dc, Colors, "Colors", colormapName(options.colormap));
+            break;
+        case Zoom:
+            sniprintf(buffer, 8, "%dx", options.zoom);
+            _drawMenuEntry(dc, Zoom, "Zoom", buffer);
+            break;
+        case PanX:
+            sniprintf(buffer, 8, "%d", options.panX);
+            _drawMenuEntry(dc, PanX, "Pan X", buffer);
+            break;
+        case PanY:
+            sniprintf(buffer, 8, "%d", options.panY);
+            _drawMenuEntry(dc, PanY, "Pan Y", buffer);
+            break;
+        case HistEqualization:
+            _drawMenuEntry(dc, HistEqualization, "Hist. eq.", options.histEqualization ? "On" : "Off");
+            break;
+        case Range:
+            switch (options.rangeMode) {
+                case RangeMode::Auto: _drawMenuEntry(dc, Range, "Range", "Auto"); break;
+                case RangeMode::Smooth: _drawMenuEntry(dc, Range, "Range", "Smooth"); break;
+                case RangeMode::Locked: _drawMenuEntry(dc, Range, "Range", "Locked"); break;
+            }
+            break;
+        case Isotherm:
+            switch (options.isotherm) {
+                case IsothermMode::Off: _drawMenuEntry(dc, Isotherm, "Isotherm", "Off"); break;
+                case IsothermMode::Above: _drawMenuEntry(dc, Isotherm, "Isotherm", "Above"); break;
+                case IsothermMode::Below: _drawMenuEntry(dc, Isotherm, "Isotherm", "Below"); break;
+            }
+            break;
+        case Threshold:
+            sniprintf(buffer, 8, "%d", options.isothermTemp);
+            _drawMenuEntry(dc, Threshold, "Threshold", buffer);
+            break;
+        case SpotMarkers:
+            _drawMenuEntry(dc, SpotMarkers, "Spot marks", options.spotMarkers ? "On" : "Off");
+            break;
+        case Record:
+            if (options.recordInterval < 0) strcpy(buffer, "Off");
+            else if (options.recordInterval == 0) strcpy(buffer, "All");
+            else sniprintf(buffer, 8, "%ds", options.recordInterval);
+            _drawMenuEntry(dc, Record, "Record", buffer);
+            break;
+        case ShowGallery:
+            _drawMenuEntry(dc, ShowGallery, "Gallery");
+            break;
         case SaveChanges:
             _drawMenuEntry(dc, SaveChanges, "Save changes");
             break;
@@ -415,7 +700,6 @@ void ApplicationUI<IOHandler>::drawMenuEntry(mxgui::DrawingContext& dc, int id)
 template<class IOHandler>
 void ApplicationUI<IOHandler>::updateMenu(mxgui::DrawingContext& dc)
 {
-    drawUSBConnectionIndicator(dc);
     if (onBtn.getAutorepeatEvent())
     {
         switch(menuEntry)
@@ -436,6 +720,68 @@ void ApplicationUI<IOHandler>::updateMenu(mxgui::DrawingContext& dc)
                 display.setBrightness(options.brightness * 6);
                 drawMenuEntry(dc, Brightness);
                 break;
+            case Colors:
+                options.colormap=static_cast<Colormap>(
+                    (static_cast<int>(options.colormap)+1)%numColormaps);
+                drawMenuEntry(dc, Colors);
+                break;
+            case Zoom:
+                if(options.zoom>=8) options.zoom=1;
+                else options.zoom*=2;
+                drawMenuEntry(dc, Zoom);
+                break;
+            case PanX:
+                options.panX=(options.panX+1)%MLX90640Frame::nx;
+                drawMenuEntry(dc, PanX);
+                break;
+            case PanY:
+                options.panY=(options.panY+1)%MLX90640Frame::ny;
+                drawMenuEntry(dc, PanY);
+                break;
+            case HistEqualization:
+                options.histEqualization=!options.histEqualization;
+                drawMenuEntry(dc, HistEqualization);
+                break;
+            case Range:
+                switch (options.rangeMode) {
+                    case RangeMode::Auto: options.rangeMode=RangeMode::Smooth; break;
+                    case RangeMode::Smooth: options.rangeMode=RangeMode::Locked; break;
+                    case RangeMode::Locked: options.rangeMode=RangeMode::Auto; break;
+                }
+                drawMenuEntry(dc, Range);
+                break;
+            case Isotherm:
+                switch (options.isotherm) {
+                    case IsothermMode::Off: options.isotherm=IsothermMode::Above; break;
+                    case IsothermMode::Above: options.isotherm=IsothermMode::Below; break;
+                    case IsothermMode::Below: options.isotherm=IsothermMode::Off; break;
+                }
+                drawMenuEntry(dc, Isotherm);
+                break;
+            case Threshold:
+                if(options.isothermTemp>=250) options.isothermTemp=-20;
+                else options.isothermTemp+=5;
+                drawMenuEntry(dc, Threshold);
+                break;
+            case SpotMarkers:
+                options.spotMarkers=!options.spotMarkers;
+                drawMenuEntry(dc, SpotMarkers);
+                break;
+            case Record:
+                //Off, every frame, then time-lapse intervals
+                switch (options.recordInterval) {
+                    case -1: options.recordInterval=0; break;
+                    case 0: options.recordInterval=1; break;
+                    case 1: options.recordInterval=10; break;
+                    case 10: options.recordInterval=60; break;
+                    default: options.recordInterval=-1; break;
+                }
+                drawMenuEntry(dc, Record);
+                drawRecordIndicator(dc);
+                break;
+            case ShowGallery:
+                enterGallery(dc);
+                return;
             case SaveChanges:
                 ioHandler.saveOptions(options);
                 break;
@@ -448,8 +794,78 @@ void ApplicationUI<IOHandler>::updateMenu(mxgui::DrawingContext& dc)
     {
         int oldEntry = menuEntry;
         menuEntry=(menuEntry+1)%NumEntries;
-        drawMenuEntry(dc, oldEntry);
-        drawMenuEntry(dc, menuEntry);
+        if (scrollMenu(dc)) {
+            for (int i=0; i<NumEntries; i++) drawMenuEntry(dc, i);
+        } else {
+            drawMenuEntry(dc, oldEntry);
+            drawMenuEntry(dc, menuEntry);
+        }
+    }
+}
+
+template<class IOHandler>
+bool ApplicationUI<IOHandler>::scrollMenu(mxgui::DrawingContext& dc)
+{
+    const int visibleEntries = (dc.getHeight()-50)/smallFont.getHeight();
+    int oldScroll = menuScroll;
+    if (menuEntry<menuScroll) menuScroll=menuEntry;
+    else if (menuEntry>=menuScroll+visibleEntries) menuScroll=menuEntry-visibleEntries+1;
+    return menuScroll!=oldScroll;
+}
+
+template<class IOHandler>
+void ApplicationUI<IOHandler>::enterGallery(mxgui::DrawingContext& dc)
+{
+    //The newest snapshot is shown first, the up button goes back in time
+    state = Gallery;
+    invalidateDrawnValues();
+    galleryCount = ioHandler.snapshotCount();
+    galleryIndex = galleryCount-1;
+    drawSnapshot(dc);
+    upBtn.ignoreUntilNextPress();
+    onBtn.ignoreUntilNextPress();
+}
+
+template<class IOHandler>
+void ApplicationUI<IOHandler>::updateGallery(mxgui::DrawingContext& dc)
+{
+    if (onBtn.getUpEvent())
+    {
+        galleryFrame.reset();
+        enterMain(dc);
+    } else if (upBtn.getAutorepeatEvent() && galleryCount > 0) {
+        galleryIndex = (galleryIndex+galleryCount-1)%galleryCount;
+        drawSnapshot(dc);
+    }
+}
+
+template<class IOHandler>
+void ApplicationUI<IOHandler>::drawSnapshot(mxgui::DrawingContext& dc)
+{
+    //The frame is only kept while it is shown, as it is a heavy object
+    if (!galleryFrame) galleryFrame = std::make_unique<MLX90640Frame>();
+    if (galleryCount == 0 ||
+        ioHandler.loadSnapshot(galleryIndex, galleryFrame.get(), galleryEmissivity) == false)
+        galleryFrame.reset();
+    if (galleryFrame && indicatorsDrawn)
+    {
+        drawStatusLine(dc);
+        renderFrame(dc, galleryFrame.get());
+        return;
+    }
+    //Redraw the whole screen, so no values of the previous snapshot are left
+    invalidateDrawnValues();
+    drawStaticPartOfMainScreen(dc);
+    drawBatteryIcon(dc);
+    indicatorsDrawn = true;
+    if (galleryFrame)
+    {
+        renderFrame(dc, galleryFrame.get());
+    } else {
+        const char *s = galleryCount == 0 ? "No snapshots" : "Damaged";
+        dc.setFont(smallFont);
+        dc.setTextColor(std::make_pair(mxgui::white,mxgui::black));
+        dc.write(mxgui::Point((dc.getWidth()-smallFont.calculateLength(s))/2,54), s);
     }
 }
 
@@ -466,6 +882,9 @@ void ApplicationUI<IOHandler>::enterShutdown(mxgui::DrawingContext& dc)
 template<class IOHandler>
 void ApplicationUI<IOHandler>::drawFrame(mxgui::DrawingContext& dc)
 {
+    //Checked again with the display locked, as the render thread may find
+    //the gallery entered while waiting for it
+    if (state == Gallery) return;
     std::shared_ptr<MLX90640Frame> frame;
     {
         std::lock_guard<std::mutex> lock(lastFrameMutex);
@@ -473,59 +892,108 @@ void ApplicationUI<IOHandler>::drawFrame(mxgui::DrawingContext& dc)
     }
     if (frame.get()!=nullptr)
     {
-        #if 0 && defined(_MIOSIX)
-        auto t1 = miosix::getTime();
-        #endif
-        bool smallCached=(state == Menu); //Cache now if the main thread changes it
-        if(smallCached==false) renderer->render(frame.get());
-        else renderer->renderSmall(frame.get());
-        #if 0 && defined(_MIOSIX)
-        auto t2 = miosix::getTime();
-        #endif
-        dc.setTextColor(std::make_pair(mxgui::white,mxgui::black));
-        if(smallCached==false)
+        renderFrame(dc, frame.get());
+        if (statusMessageFrames > 0 && --statusMessageFrames == 0 && state == Main)
+            drawStatusLine(dc);
+    }
+}
+
+template<class IOHandler>
+void ApplicationUI<IOHandler>::renderFrame(mxgui::DrawingContext& dc, MLX90640Frame *frame)
+{
+    #if 0 && defined(_MIOSIX)
+    auto t1 = miosix::getTime();
+    #endif
+    bool smallCached=(state == Menu); //Cache now if the main thread changes it
+    renderer->setColormap(options.colormap);
+    renderer->setHistogramEqualization(options.histEqualization);
+    //Snapshots are unrelated to each other, so their range is not smoothed
+    renderer->setRangeMode(state == Gallery ? RangeMode::Auto : options.rangeMode);
+    renderer->setZoom(options.zoom,options.panX,options.panY);
+    renderer->setIsotherm(options.isotherm,options.isothermTemp);
+    renderer->setSpotMarkers(options.spotMarkers);
+    if(smallCached==false) renderer->render(frame);
+    else renderer->renderSmall(frame);
+    #if 0 && defined(_MIOSIX)
+    auto t2 = miosix::getTime();
+    #endif
+    if(renderer->alarm()!=drawnAlarm)
+    {
+        drawnAlarm=renderer->alarm();
+        drawImageBorder(dc,drawnAlarm);
+    }
+    dc.setTextColor(std::make_pair(mxgui::white,mxgui::black));
+    if(smallCached==false)
+    {
+        //For mxgui::point coordinates see ui-mockup-main-screen.png
+        renderer->draw(dc,mxgui::Point(1,13));
+        drawTemperature(dc,mxgui::Point(0,114),mxgui::Point(16,122),smallDigits,
+                        renderer->minTemperature(),drawnMinTemp);
+        drawTemperature(dc,mxgui::Point(99,114),mxgui::Point(115,122),smallDigits,
+                        renderer->maxTemperature(),drawnMaxTemp);
+        drawTemperature(dc,mxgui::Point(38,108),mxgui::Point(70,122),largeDigits,
+                        renderer->crosshairTemperature(),drawnCrosshairTemp);
+        mxgui::Color *buffer=dc.getScanLineBuffer();
+        renderer->legend(buffer,dc.getWidth());
+        if(legendDrawn==false || memcmp(buffer,drawnLegend,sizeof(drawnLegend))!=0)
         {
-            //For mxgui::point coordinates see ui-mockup-main-screen.png
-            renderer->draw(dc,mxgui::Point(1,13));
-            drawTemperature(dc,mxgui::Point(0,114),mxgui::Point(16,122),smallFont,
-                            renderer->minTemperature());
-            drawTemperature(dc,mxgui::Point(99,114),mxgui::Point(115,122),smallFont,
-                            renderer->maxTemperature());
-            drawTemperature(dc,mxgui::Point(38,108),mxgui::Point(70,122),largeFont,
-                            renderer->crosshairTemperature());
-            mxgui::Color *buffer=dc.getScanLineBuffer();
-            renderer->legend(buffer,dc.getWidth());
+            memcpy(drawnLegend,buffer,sizeof(drawnLegend));
+            legendDrawn=true;
             for(int y=124;y<=127;y++)
                 dc.scanLineBuffer(mxgui::Point(0,y),dc.getWidth());
-        } else {
-            //For mxgui::point coordinates see ui-mockup-menu-screen.png
-            renderer->drawSmall(dc,mxgui::Point(1,1));
-            drawTemperature(dc,mxgui::Point(96,12),mxgui::Point(112,20),smallFont,
-                            renderer->maxTemperature());
-            drawTemperature(dc,mxgui::Point(96,25),mxgui::Point(112,33),smallFont,
-                            renderer->minTemperature());
         }
-        #if 0 && defined(_MIOSIX)
-        auto t3 = miosix::getTime();
-        iprintf("render = %lld draw = %lld\n",t2-t1,t3-t2);
-        #endif
-        //process = 78ms render = 1.9ms draw = 15ms 8Hz scaled short DMA UI
+    } else {
+        //For mxgui::point coordinates see ui-mockup-menu-screen.png
+        renderer->drawSmall(dc,mxgui::Point(1,1));
+        drawTemperature(dc,mxgui::Point(96,12),mxgui::Point(112,20),smallDigits,
+                        renderer->maxTemperature(),drawnMaxTemp);
+        drawTemperature(dc,mxgui::Point(96,25),mxgui::Point(112,33),smallDigits,
+                        renderer->minTemperature(),drawnMinTemp);
     }
+    #if 0 && defined(_MIOSIX)
+    auto t3 = miosix::getTime();
+    iprintf("render = %lld draw = %lld\n",t2-t1,t3-t2);
+    #endif
+    //process = 78ms render = 1.9ms draw = 15ms 8Hz scaled short DMA UI
 }
 
 template<class IOHandler>
 void ApplicationUI<IOHandler>::drawTemperature(mxgui::DrawingContext& dc, 
-    mxgui::Point a, mxgui::Point b, mxgui::Font f, short temperature)
+    mxgui::Point a, mxgui::Point b, GlyphCache& digits, short temperature, short& drawn)
 {
-    char line[8];
-    sniprintf(line,sizeof(line),"%3d",temperature);
-    int len=f.calculateLength(line);
-    int toBlank=b.x()-a.x()-len;
-    if(toBlank>0)
+    if(temperature==drawn) return; //Skip sending unchanged values to the display
+    drawn=temperature;
+    digits.draw(dc,a,b,temperature);
+}
+
+template<class IOHandler>
+void ApplicationUI<IOHandler>::invalidateDrawnValues()
+{
+    drawnMinTemp=drawnMaxTemp=drawnCrosshairTemp=SHRT_MIN;
+    legendDrawn=false;
+    drawnAlarm=false; //The static part of the screen is drawn without alarm
+    indicatorsDrawn=false;
+}
+
+template<class IOHandler>
+void ApplicationUI<IOHandler>::drawImageBorder(mxgui::DrawingContext& dc, bool alarm)
+{
+    //The border around the thermal image turns red while the alarm is active
+    const mxgui::Color red=to565(255,0,0);
+    const mxgui::Color darkGrey=alarm ? red : to565(128,128,128);
+    const mxgui::Color lightGrey=alarm ? red : to565(192,192,192);
+    if(state == Main || state == Gallery)
     {
-        dc.clear(a,mxgui::Point(a.x()+toBlank,b.y()),mxgui::black);
-        a=mxgui::Point(a.x()+toBlank+1,a.y());
+        //For mxgui::point coordinates see ui-mockup-main-screen.png
+        dc.line(mxgui::Point(0,12),mxgui::Point(0,107),darkGrey);
+        dc.line(mxgui::Point(1,12),mxgui::Point(127,12),darkGrey);
+        dc.line(mxgui::Point(127,13),mxgui::Point(127,107),lightGrey);
+        dc.line(mxgui::Point(1,107),mxgui::Point(126,107),lightGrey);
+    } else {
+        //For mxgui::point coordinates see ui-mockup-menu-screen.png
+        dc.line(mxgui::Point(0,0),mxgui::Point(0,48),darkGrey);
+        dc.line(mxgui::Point(1,0),mxgui::Point(64,0),darkGrey);
+        dc.line(mxgui::Point(1,48),mxgui::Point(64,48),lightGrey);
+        dc.line(mxgui::Point(64,1),mxgui::Point(64,47),lightGrey);
     }
-    dc.setFont(f);
-    dc.clippedWrite(a,a,b,line);
 }
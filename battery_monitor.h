@@ -0,0 +1,108 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include "drivers/misc.h"
+#include <algorithm>
+
+/**
+ * Filters the battery voltage measurements, and derives from them the
+ * battery level shown in the UI and an estimate of the remaining runtime.
+ * The filter state is in fixed point with 4 fractional bits.
+ */
+class BatteryMonitor
+{
+public:
+    /**
+     * Add a measurement
+     * \param millivolts battery voltage in millivolts
+     * \param time time of the measurement in nanoseconds
+     */
+    void update(int millivolts, long long time)
+    {
+        if(valid==false)
+        {
+            valid=true;
+            filtered=millivolts<<fractionalBits;
+            currentLevel=batteryLevel(millivolts);
+            referenceMillivolts=millivolts;
+            referenceTime=time;
+            return;
+        }
+        filtered+=((millivolts<<fractionalBits)-filtered)>>filterShift;
+        int mv=this->millivolts();
+        //Level changes only once the voltage is past the threshold by the
+        //hysteresis, to avoid the icon flickering due to load changes
+        BatteryLevel fuller=batteryLevel(mv-hysteresis);
+        BatteryLevel emptier=batteryLevel(mv+hysteresis);
+        if(fuller<currentLevel) currentLevel=fuller;
+        else if(emptier>currentLevel) currentLevel=emptier;
+        //Discharge rate is measured over a long window, as the voltage
+        //drops by just a few millivolts per minute
+        if(time-referenceTime>=slopeWindow)
+        {
+            int drop=referenceMillivolts-mv;
+            int minutes=(time-referenceTime)/60000000000LL;
+            if(drop>0)
+                runtime=std::max(0,mv-emptyMillivolts)*minutes/drop;
+            else runtime=-1; //Charging or load too low to measure
+            referenceMillivolts=mv;
+            referenceTime=time;
+        }
+    }
+
+    /**
+     * \return the filtered battery voltage in millivolts
+     */
+    int millivolts() const { return filtered>>fractionalBits; }
+
+    /**
+     * \return the battery level, valid after the first call to update()
+     */
+    BatteryLevel level() const { return currentLevel; }
+
+    /**
+     * \return the estimated remaining runtime in minutes, or -1 if not yet
+     * known or the battery is not discharging
+     */
+    int runtimeMinutes() const { return runtime; }
+
+private:
+    static const int fractionalBits=4;
+    static const int filterShift=3;      ///< IIR filter coefficient is 1/8
+    static const int hysteresis=25;      ///< Level hysteresis in millivolts
+    static const int emptyMillivolts=3500;
+    static constexpr long long slopeWindow=5*60000000000LL; //5 minutes
+
+    bool valid=false;
+    int filtered=0;
+    BatteryLevel currentLevel=BatteryLevel::B100;
+    int referenceMillivolts=0;
+    long long referenceTime=0;
+    int runtime=-1;
+};
@@ -1,38 +1,131 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
 #include "colormap.h"
+#include <utility>
+
+/*
+ * All colormaps are specified as RGB888 and converted to RGB565 at compile
+ * time. Thermal and jet are sampled from the Scilab colormaps in
+ * _tools/colormap_encoder, the others are computed here.
+ */
+
+struct RGB888
+{
+    unsigned char r, g, b;
+};
+
+struct Palette
+{
+    unsigned short color[256];
+};
+
+static constexpr unsigned short to565(RGB888 c)
+{
+    return ((c.r & 0b11111000) << 8) | ((c.g & 0b11111100) << 3) | ((c.b & 0b11111000) >> 3);
+}
+
+static constexpr RGB888 thermalSource[256] =
+{
+#include "_tools/colormap_encoder/thermalcolormap"
+};
+
+static constexpr RGB888 jetSource[256] =
+{
+#include "_tools/colormap_encoder/jetcolormap"
+};
 
-//Autogenerated by colormap_encoder.cpp
-const unsigned short colormap[256] = 
-{
-    0x0000,0x0000,0x0001,0x0001,0x0002,0x0003,0x0003,0x0004,
-    0x0005,0x0005,0x0006,0x0006,0x0007,0x0008,0x0008,0x0009,
-    0x000a,0x000a,0x000b,0x000b,0x000c,0x000d,0x000d,0x000e,
-    0x000f,0x000f,0x0010,0x0010,0x0011,0x0012,0x0012,0x0013,
-    0x0014,0x0014,0x0015,0x0015,0x0016,0x0017,0x0017,0x0018,
-    0x0019,0x0019,0x001a,0x001a,0x001b,0x001c,0x001c,0x001d,
-    0x001e,0x001e,0x001f,0x001f,0x003f,0x005f,0x007f,0x00bf,
-    0x00df,0x00ff,0x011f,0x015f,0x017f,0x019f,0x01bf,0x01ff,
-    0x021f,0x023f,0x025f,0x029f,0x02bf,0x02df,0x02ff,0x033f,
-    0x035f,0x037f,0x039f,0x03df,0x03ff,0x041f,0x043f,0x047f,
-    0x049f,0x04bf,0x04df,0x051f,0x053f,0x055f,0x057f,0x05bf,
-    0x05df,0x05ff,0x061f,0x065f,0x067f,0x069f,0x06bf,0x06ff,
-    0x071f,0x073f,0x075f,0x079f,0x07bf,0x07df,0x07ff,0x07ff,
-    0x0ffe,0x0ffe,0x17fd,0x1ffc,0x1ffc,0x27fb,0x2ffa,0x2ffa,
-    0x37f9,0x37f9,0x3ff8,0x47f7,0x47f7,0x4ff6,0x57f5,0x57f5,
-    0x5ff4,0x5ff4,0x67f3,0x6ff2,0x6ff2,0x77f1,0x7ff0,0x7ff0,
-    0x87ef,0x87ef,0x8fee,0x97ed,0x97ed,0x9fec,0xa7eb,0xa7eb,
-    0xafea,0xafea,0xb7e9,0xbfe8,0xbfe8,0xc7e7,0xcfe6,0xcfe6,
-    0xd7e5,0xd7e5,0xdfe4,0xe7e3,0xe7e3,0xefe2,0xf7e1,0xf7e1,
-    0xffe0,0xffe0,0xffc0,0xffa0,0xff80,0xff40,0xff20,0xff00,
-    0xfee0,0xfea0,0xfe80,0xfe60,0xfe40,0xfe00,0xfde0,0xfdc0,
-    0xfda0,0xfd60,0xfd40,0xfd20,0xfd00,0xfcc0,0xfca0,0xfc80,
-    0xfc60,0xfc20,0xfc00,0xfbe0,0xfbc0,0xfb80,0xfb60,0xfb40,
-    0xfb20,0xfae0,0xfac0,0xfaa0,0xfa80,0xfa40,0xfa20,0xfa00,
-    0xf9e0,0xf9a0,0xf980,0xf960,0xf940,0xf900,0xf8e0,0xf8c0,
-    0xf8a0,0xf860,0xf840,0xf820,0xf800,0xf820,0xf841,0xf861,
-    0xf8a2,0xf8c3,0xf8e3,0xf904,0xf945,0xf965,0xf986,0xf9a6,
-    0xf9e7,0xfa08,0xfa28,0xfa49,0xfa8a,0xfaaa,0xfacb,0xfaeb,
-    0xfb2c,0xfb4d,0xfb6d,0xfb8e,0xfbcf,0xfbef,0xfc10,0xfc30,
-    0xfc71,0xfc92,0xfcb2,0xfcd3,0xfd14,0xfd34,0xfd55,0xfd75,
-    0xfdb6,0xfdd7,0xfdf7,0xfe18,0xfe59,0xfe79,0xfe9a,0xfeba,
-    0xfefb,0xff1c,0xff3c,0xff5d,0xff9e,0xffbe,0xffdf,0xffff,
+/**
+ * Ironbow is defined by control points, and linearly interpolated in between
+ */
+static constexpr RGB888 ironbowPoints[] =
+{
+    {  0,  0,  0},
+    { 32,  0,140},
+    {204,  0,119},
+    {255,165,  0},
+    {255,215,  0},
+    {255,255,255}
+};
+
+static constexpr RGB888 ironbowSample(int i)
+{
+    const int segments=sizeof(ironbowPoints)/sizeof(ironbowPoints[0])-1;
+    int segment=i*segments/256;
+    int x=i*segments-segment*256; //Position within the segment, 0..255
+    RGB888 a=ironbowPoints[segment], b=ironbowPoints[segment+1];
+    return { static_cast<unsigned char>(a.r+(b.r-a.r)*x/255),
+             static_cast<unsigned char>(a.g+(b.g-a.g)*x/255),
+             static_cast<unsigned char>(a.b+(b.b-a.b)*x/255) };
+}
+
+template<std::size_t... I>
+static constexpr Palette fromTable(const RGB888 *table, std::index_sequence<I...>)
+{
+    return {{ to565(table[I])... }};
+}
+
+template<std::size_t... I>
+static constexpr Palette ironbow(std::index_sequence<I...>)
+{
+    return {{ to565(ironbowSample(I))... }};
+}
+
+template<std::size_t... I>
+static constexpr Palette gray(bool whiteHot, std::index_sequence<I...>)
+{
+    return {{ to565({ static_cast<unsigned char>(whiteHot ? I : 255-I),
+                      static_cast<unsigned char>(whiteHot ? I : 255-I),
+                      static_cast<unsigned char>(whiteHot ? I : 255-I) })... }};
+}
+
+static constexpr Palette palettes[numColormaps] =
+{
+    fromTable(thermalSource,std::make_index_sequence<256>()),
+    ironbow(std::make_index_sequence<256>()),
+    fromTable(jetSource,std::make_index_sequence<256>()),
+    gray(true,std::make_index_sequence<256>()),
+    gray(false,std::make_index_sequence<256>())
 };
+
+const unsigned short *colormapData(Colormap c)
+{
+    return palettes[static_cast<int>(c)].color;
+}
+
+const char *colormapName(Colormap c)
+{
+    switch(c)
+    {
+        case Colormap::Thermal:  return "Thermal";
+        case Colormap::Ironbow:  return "Ironbow";
+        case Colormap::Jet:      return "Jet";
+        case Colormap::WhiteHot: return "White hot";
+        case Colormap::BlackHot: return "Black hot";
+    }
+    return "";
+}
@@ -1,3 +1,56 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
 #pragma once
 
-extern const unsigned short colormap[256];
+/**
+ * Available colormaps, in the order they are selected from the menu
+ */
+enum class Colormap : unsigned char
+{
+    Thermal,
+    Ironbow,
+    Jet,
+    WhiteHot,
+    BlackHot
+};
+
+const int numColormaps=5; ///< Number of entries in the Colormap enum
+
+/**
+ * \param c colormap
+ * \return a 256 entry RGB565 table mapping the coldest (index 0) to the
+ * hottest (index 255) temperature. Tables are computed at compile time and
+ * stored in FLASH
+ */
+const unsigned short *colormapData(Colormap c);
+
+/**
+ * \param c colormap
+ * \return the colormap name, for display purpose
+ */
+const char *colormapName(Colormap c);
@@ -219,7 +219,7 @@ void MLX90640_CalculateTo(const uint16_t *frameData, const paramsMLX90640 *param
 
 //------------------------------------------------------------------------------
 
-void MLX90640_CalculateToShort(const uint16_t *frameData, const paramsMLX90640 *params, float emissivity, float vdd, float ta, float tr, short *result)
+void MLX90640_CalculateToShort(const uint16_t *frameData, const paramsMLX90640 *params, float emissivity, float vdd, float ta, float tr, short *result, statsMLX90640 *stats)
 {
     //float vdd;
     //float ta;
@@ -346,13 +346,25 @@ void MLX90640_CalculateToShort(const uint16_t *frameData, const paramsMLX90640 *
             To = quadrtf(irData / (alphaCompensated * alphaCorrR[range] * (1 + params->ksTo[range] * (To - params->ct[range]))) + taTr) - 273.15;
             
             //Clamp to -99..999°C multiplied by scaleFactor
-            result[pixelNumber] = static_cast<short>(
+            short t = static_cast<short>(
                 static_cast<float>(scaleFactor)*
                     (To>0.f ? std::min(999.f,To+0.5f) : std::max(-99.f,To-0.5f)));
+            result[pixelNumber] = t;
+            MLX90640_AccumulateStats(stats, t, pixelNumber);
         }
     }
 }
 
+void MLX90640_ResetStats(statsMLX90640 *stats)
+{
+    stats->minTemp = 32767;
+    stats->maxTemp = -32768;
+    stats->argMin = 0;
+    stats->argMax = 0;
+    stats->sum = 0;
+    for(int i = 0; i < statsHistogramBins; i++) stats->histogram[i] = 0;
+}
+
 //------------------------------------------------------------------------------
 
 void MLX90640_GetImage(const uint16_t *frameData, const paramsMLX90640 *params, float *result)
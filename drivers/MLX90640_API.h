@@ -20,6 +20,7 @@
  * made compatible with Miosix
  * Modified by DC: Removed I2C interface functions, now replaced with a new
  * optimized driver in mlx90640.h.
+ * Modified by TFT: MLX90640_CalculateToShort also computes statistics.
  */
 
 #ifndef _MLX640_API_H_
@@ -32,6 +33,25 @@
  */
 const int scaleFactor=4;
 
+/*
+ * Coarse histogram computed by MLX90640_CalculateToShort. Bin i contains
+ * pixels whose scaled temperature t is such that (t-statsHistogramBase)>>
+ * statsHistogramShift==i, pixels outside the histogram go in the first/last bin
+ */
+const int statsHistogramBins=32;
+const int statsHistogramShift=5; //Bin width is 32/scaleFactor=8°C
+const int statsHistogramBase=-32*scaleFactor;
+
+typedef struct
+{
+    int16_t minTemp;
+    int16_t maxTemp;
+    uint16_t argMin;
+    uint16_t argMax;
+    int32_t sum;
+    uint16_t histogram[statsHistogramBins];
+} statsMLX90640;
+
 
 typedef struct
 {
@@ -66,6 +86,26 @@ float MLX90640_GetVdd(const uint16_t *frameData, const paramsMLX90640 *params);
 float MLX90640_GetTa(const uint16_t *frameData, const paramsMLX90640 *params, float vdd);
 void MLX90640_GetImage(const uint16_t *frameData, const paramsMLX90640 *params, float *result);
 void MLX90640_CalculateTo(const uint16_t *frameData, const paramsMLX90640 *params, float emissivity, float vdd, float ta, float tr, float *result);
-void MLX90640_CalculateToShort(const uint16_t *frameData, const paramsMLX90640 *params, float emissivity, float vdd, float ta, float tr, short *result);
+void MLX90640_CalculateToShort(const uint16_t *frameData, const paramsMLX90640 *params, float emissivity, float vdd, float ta, float tr, short *result, statsMLX90640 *stats);
+void MLX90640_ResetStats(statsMLX90640 *stats);
+
+inline void MLX90640_AccumulateStats(statsMLX90640 *stats, short t, int pixelNumber)
+{
+    if(t < stats->minTemp)
+    {
+        stats->minTemp = t;
+        stats->argMin = pixelNumber;
+    }
+    if(t > stats->maxTemp)
+    {
+        stats->maxTemp = t;
+        stats->argMax = pixelNumber;
+    }
+    stats->sum += t;
+    int bin = (t - statsHistogramBase) >> statsHistogramShift;
+    if(bin < 0) bin = 0;
+    if(bin >= statsHistogramBins) bin = statsHistogramBins - 1;
+    stats->histogram[bin]++;
+}
     
 #endif
@@ -0,0 +1,58 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+
+/*
+ * CRC16 CCITT, used to validate data stored in FLASH and the USB packets.
+ * It is the same CRC as crc16() in miosix/util/crc16.h, but it can also be
+ * used by the host tools, and it is computed incrementally so that the data
+ * need not be contiguous in memory.
+ */
+
+const uint16_t crc16Init=0xffff; ///< Initial value of the CRC
+
+/**
+ * Add data to a CRC16 CCITT
+ * \param crc crc16Init for the first block, the previous result otherwise
+ * \param data data to add to the CRC
+ * \param size size of data in bytes
+ * \return the updated CRC
+ */
+inline uint16_t crc16Update(uint16_t crc, const void *data, int size)
+{
+    auto *p=reinterpret_cast<const uint8_t*>(data);
+    for(int i=0;i<size;i++)
+    {
+        uint16_t x=((crc>>8)^p[i]) & 0xff;
+        x^=x>>4;
+        crc=(crc<<8)^(x<<12)^(x<<5)^x;
+    }
+    return crc;
+}
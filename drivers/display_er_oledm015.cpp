@@ -27,7 +27,6 @@
 
 #include "display_er_oledm015.h"
 #include <miosix.h>
-#include <interfaces/endianness.h>
 #include <algorithm>
 #include <line.h>
 #include "hwmapping.h"
@@ -102,25 +101,33 @@ void SPI1txDmaHandlerImpl()
     waiting=nullptr;
 }
 
+/**
+ * Send pixels to the display using DMA. The SPI is temporarily switched to
+ * 16 bit frames, so that pixels are sent MSB first as the display requires
+ * without the need to swap their endianness in memory
+ * \param data pixels to send, can also point to read-only memory (FLASH)
+ * \param size number of pixels to send, must be less than 65536
+ */
 static void spi1SendDMA(const Color *data, int size)
 {
     error=false;
     unsigned short tempCr1=SPI1->CR1;
     SPI1->CR1=0;
     SPI1->CR2=SPI_CR2_TXDMAEN;
-    SPI1->CR1=tempCr1;
+    SPI1->CR1=tempCr1 | SPI_CR1_DFF; //16 bit data frame
     
     waiting=Thread::getCurrentThread();
 
     DMA2_Stream3->CR=0;
     DMA2_Stream3->PAR=reinterpret_cast<unsigned int>(&SPI1->DR);
     DMA2_Stream3->M0AR=reinterpret_cast<unsigned int>(data);
-    DMA2_Stream3->NDTR=2*size; //Size is at the peripheral side (8bit)
+    DMA2_Stream3->NDTR=size; //Size is at the peripheral side (16bit)
     DMA2_Stream3->FCR=DMA_SxFCR_FEIE
                     | DMA_SxFCR_DMDIS;
     DMA2_Stream3->CR=DMA_SxCR_CHSEL_0 //Channel 3 SPI1
                    | DMA_SxCR_CHSEL_1
-                   //| DMA_SxCR_MSIZE_0 //Memory size 16 bit
+                   | DMA_SxCR_MSIZE_0 //Memory size 16 bit
+                   | DMA_SxCR_PSIZE_0 //Peripheral size 16 bit
                    | DMA_SxCR_MINC    //Increment memory pointer
                    | DMA_SxCR_DIR_0   //Memory to peripheral
                    | DMA_SxCR_TCIE    //Interrupt on transfer complete
@@ -136,7 +143,7 @@ static void spi1SendDMA(const Color *data, int size)
     spi1waitCompletion();
     SPI1->CR1=0;
     SPI1->CR2=0;
-    SPI1->CR1=tempCr1;
+    SPI1->CR1=tempCr1; //Back to 8 bit data frame for commands
     //if(error) puts("SPI1 DMA tx failed"); //TODO: look into why this fails
 }
 
@@ -229,7 +236,7 @@ static inline void imageWindow(Point p1, Point p2)
 
 namespace mxgui {
 
-DisplayErOledm015::DisplayErOledm015() : buffer(nullptr), buffer2(nullptr)
+DisplayErOledm015::DisplayErOledm015() : buffer(nullptr)
 {
     {
         GlobalIrqLock dLock;
@@ -374,21 +381,18 @@ void DisplayErOledm015::line(Point a, Point b, Color color)
 
 void DisplayErOledm015::scanLine(Point p, const Color *colors, unsigned short length)
 {
-    if(buffer2==nullptr) buffer2=new Color[buffer2Size];
     length=min<unsigned short>(length,width-p.x());
     imageWindow(p,Point(length-1,p.y()));
     cmd(0x5c);
     dc::high();
     cs::low();
-    for(int i=0;i<length;i++) buffer2[i]=toBigEndian16(colors[i]);
-    spi1SendDMA(buffer2,length);
+    spi1SendDMA(colors,length);
     cs::high();
     delayUs(1);
 }
 
 Color *DisplayErOledm015::getScanLineBuffer()
 {
-    //getWidth() would be enough as size, but we reuse the buffer for DMA
     if(buffer==nullptr) buffer=new Color[getWidth()];
     return buffer;
 }
@@ -403,26 +407,16 @@ void DisplayErOledm015::drawImage(Point p, const ImageBase& img)
     const Color *imgData=img.getData();
     if(imgData!=0)
     {
-        if(buffer2==nullptr) buffer2=new Color[buffer2Size];
         short int xEnd=p.x()+img.getWidth()-1;
         short int yEnd=p.y()+img.getHeight()-1;
         imageWindow(p,Point(xEnd,yEnd));
         cmd(0x5c);
         dc::high();
         cs::low();
-        //Unfortunately the DMA requires the endianness to be swapped, the
-        //pointer we get is read-only (can be in flash), and we may not have
-        //enough memory to allocate a large enough buffer to hold the entire
-        //image, so we'll have to split it in chunks
-        int imgSize=img.getHeight()*img.getWidth();
-        while(imgSize>0)
-        {
-            int chunkSize=min(imgSize,buffer2Size);
-            for(int i=0;i<chunkSize;i++) buffer2[i]=toBigEndian16(imgData[i]);
-            spi1SendDMA(buffer2,chunkSize);
-            imgSize-=chunkSize;
-            imgData+=chunkSize;
-        }
+        //The DMA sends pixels straight from the image, which may be in flash.
+        //The largest image is the whole screen (16K pixels), which fits in a
+        //single DMA transfer
+        spi1SendDMA(imgData,img.getHeight()*img.getWidth());
         cs::high();
         delayUs(1);
     } else img.draw(*this,p);
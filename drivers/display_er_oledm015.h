@@ -297,9 +297,7 @@ private:
     
     static void doEndPixelWrite();
     
-    Color *buffer;                    ///< For scanLineBuffer
-    Color *buffer2;                   ///< For DMA transfers
-    static const int buffer2Size=512; ///< DMA buffer size
+    Color *buffer; ///< For scanLineBuffer
 };
 
 } //namespace mxgui
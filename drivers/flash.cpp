@@ -32,6 +32,9 @@
 using namespace std;
 using namespace miosix;
 
+/// Reads up to this size are done by polling, see Flash::read()
+static const int maxPolledRead=16;
+
 /**
  * Transfer a byte through SPI2 where the flash is connected
  * \param data byte to send
@@ -152,10 +155,24 @@ bool Flash::read(unsigned int addr, void *data, int size)
     if(addr>=this->size() || addr+size>this->size()) return false;
     lock_guard<mutex> l(m);
     flash_cs::low();
-    spi2sendRecv(0x03); //Read command is acceptable because F < 33MHz
+    //SPI2 is on APB1, so SCK is at most 30MHz/2=15MHz, which is the speed it
+    //runs at. The read command is acceptable up to 50MHz, fast read (0x0B)
+    //would only add a dummy byte, and dual output (0x3B) is not possible as
+    //the SPI can't receive on two lines
+    spi2sendRecv(0x03);
     spi2sendRecv((addr>>16) & 0xff);
     spi2sendRecv((addr>>8) & 0xff);
     spi2sendRecv(addr & 0xff);
+
+    //Short reads, such as record headers, are faster polled than paying for
+    //the DMA setup, the context switch and the RXONLY quirks below
+    if(size<=maxPolledRead)
+    {
+        auto *p=reinterpret_cast<unsigned char*>(data);
+        for(int i=0;i<size;i++) p[i]=spi2sendRecv();
+        flash_cs::high();
+        return true;
+    }
     
     //DMA1 stream 3 channel 0 = SPI2_RX
 
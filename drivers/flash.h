@@ -28,10 +28,16 @@
 #pragma once
 
 #include <mutex>
+#ifdef _MIOSIX
 #include <miosix.h>
+#else //_MIOSIX
+#include <vector>
+#endif //_MIOSIX
 
 /**
- * Class to access a 25Q64 FLASH memory
+ * Class to access a 25Q64 FLASH memory. On the host, the same interface is
+ * implemented by an emulator backed by a file (see _tools/flashemu), to test
+ * the storage code
  */
 class Flash
 {
@@ -93,6 +99,58 @@ public:
      * \return true on success, false on failure
      */
     bool read(unsigned int addr, void *data, int size);
+
+    #ifndef _MIOSIX
+    /**
+     * Host only: back the emulated FLASH with a file, created erased if it
+     * does not exist. Must be called before any other operation
+     * \param path file path
+     * \return false on error
+     */
+    bool open(const char *path);
+
+    /**
+     * Host only: if enabled, operations sleep for their typical duration on
+     * the hardware, so code using the FLASH from multiple threads sees
+     * realistic timing. The simulated time is counted in any case
+     */
+    void setRealTime(bool enabled) { realTime=enabled; }
+
+    /**
+     * Host only: simulate a power loss during the n-th program or erase
+     * operation from now, 1 being the next one. That operation is only
+     * partially done, then the process exits immediately with exit code
+     * powerLossExitCode, leaving the file as the FLASH would be
+     * \param n operations, 0 to disable
+     */
+    void powerLossAfter(int n) { powerLossCountdown=n; }
+
+    /**
+     * Host only: seed the generator of the damage left by a simulated power
+     * loss, so that a run can be reproduced
+     * \param seed seed
+     */
+    void setSeed(unsigned int seed);
+
+    static const int powerLossExitCode=3;
+
+    /**
+     * Host only: operation counters
+     */
+    struct Stats
+    {
+        long long reads=0, bytesRead=0;
+        long long programs=0, bytesProgrammed=0;
+        long long sectorErases=0, blockErases=0;
+        long long busyTime=0; ///< Simulated time in ns the FLASH was busy
+        std::vector<int> erasesPerSector; ///< Wear, blocks count as sectors
+    };
+
+    /**
+     * \return the operation counters
+     */
+    Stats stats();
+    #endif //_MIOSIX
     
 private:
     Flash();
@@ -100,6 +158,8 @@ private:
     Flash(const Flash&)=delete;
     Flash& operator= (const Flash&)=delete;
 
+    #ifdef _MIOSIX
+
     /**
      * Send the write enable command, required before writing/erasing.
      * Requires the mutex to be locked.
@@ -126,4 +186,28 @@ private:
     std::mutex m; ///Mutex to protect concurrent access to the hardware
     miosix::Thread *waiting;
     bool error;
+    #else //_MIOSIX
+    /**
+     * Count an operation, sleeping if realTime is set
+     * \param ns typical duration of the operation on the hardware
+     */
+    void busy(long long ns);
+
+    /**
+     * Report misuse of the FLASH and abort, as it is a bug to be fixed
+     */
+    [[noreturn]] void violation(const char *what, unsigned int addr);
+
+    /**
+     * Decrement the power loss countdown
+     * \return true if power is lost during the current operation
+     */
+    bool powerLost();
+
+    std::mutex m; ///Mutex to protect concurrent access to the emulator
+    unsigned char *mem=nullptr; ///< The memory mapped file
+    bool realTime=false;
+    int powerLossCountdown=0;
+    Stats counters;
+    #endif //_MIOSIX
 };
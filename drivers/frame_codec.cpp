@@ -0,0 +1,92 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "frame_codec.h"
+
+using namespace std;
+
+//
+// class FrameEncoder
+//
+
+FrameEncoder::FrameEncoder(int words, int keyframeInterval)
+    : previous(new uint16_t[words]), words(words),
+      keyframeInterval(keyframeInterval) {}
+
+int FrameEncoder::encode(const uint16_t *frame, uint8_t *out, bool& keyframe)
+{
+    keyframe=counter==0;
+    if(++counter>=keyframeInterval) counter=0;
+    uint8_t *p=out;
+    uint16_t last=0;
+    for(int i=0;i<words;i++)
+    {
+        int16_t delta=frame[i]-(keyframe ? last : previous[i]);
+        uint16_t zigzag=(static_cast<uint16_t>(delta)<<1)^(delta>>15);
+        while(zigzag>=0x80)
+        {
+            *p++=zigzag | 0x80;
+            zigzag>>=7;
+        }
+        *p++=zigzag;
+        last=previous[i]=frame[i];
+    }
+    return p-out;
+}
+
+//
+// class FrameDecoder
+//
+
+FrameDecoder::FrameDecoder(int words) : previous(new uint16_t[words]),
+    words(words) {}
+
+bool FrameDecoder::decode(const uint8_t *in, int size, bool keyframe,
+                          uint16_t *frame)
+{
+    if(keyframe==false && valid==false) return false;
+    valid=false; //Until the frame is successfully decoded
+    const uint8_t *end=in+size;
+    uint16_t last=0;
+    for(int i=0;i<words;i++)
+    {
+        uint16_t zigzag=0;
+        for(int shift=0;;shift+=7)
+        {
+            if(in>=end || shift>14) return false;
+            uint8_t byte=*in++;
+            zigzag|=(byte & 0x7f)<<shift;
+            if((byte & 0x80)==0) break;
+        }
+        int16_t delta=(zigzag>>1)^-(zigzag & 1);
+        last=previous[i]=(keyframe ? last : previous[i])+delta;
+        frame[i]=last;
+    }
+    if(in!=end) return false;
+    valid=true;
+    return true;
+}
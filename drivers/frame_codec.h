@@ -0,0 +1,126 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+/*
+ * Lossless codec for streams of frames made of 16 bit words, such as raw
+ * MLX90640 subframes or processed temperatures, shared by the firmware and
+ * the host tools.
+ *
+ * Each word is coded as its difference from the same word in the previous
+ * frame, as consecutive thermal frames are highly correlated. Keyframes,
+ * which are periodically sent to recover from lost frames, code each word as
+ * the difference from the previous word of the same frame instead. Differences
+ * are zigzag encoded, so that small negative values become small positive
+ * ones, then written as a varint (7 bits per byte, least significant first,
+ * high bit set if more bytes follow), so at most 3 bytes per word.
+ */
+
+/**
+ * Frame encoder
+ */
+class FrameEncoder
+{
+public:
+    /**
+     * Constructor
+     * \param words number of words in a frame
+     * \param keyframeInterval one frame every keyframeInterval is a keyframe
+     */
+    FrameEncoder(int words, int keyframeInterval);
+
+    /**
+     * \param words number of words in a frame
+     * \return the worst case encoded size in bytes
+     */
+    static constexpr int maxEncodedSize(int words) { return 3*words; }
+
+    /**
+     * Encode a frame
+     * \param frame frame to encode
+     * \param out encoded frame, at least maxEncodedSize() bytes
+     * \param keyframe set to true if the frame was encoded as a keyframe
+     * \return the encoded size in bytes
+     */
+    int encode(const uint16_t *frame, uint8_t *out, bool& keyframe);
+
+    /**
+     * Make the next frame a keyframe, to be called if the decoder lost frames
+     */
+    void forceKeyframe() { counter=0; }
+
+private:
+    FrameEncoder(const FrameEncoder&)=delete;
+    FrameEncoder& operator=(const FrameEncoder&)=delete;
+
+    std::unique_ptr<uint16_t[]> previous; ///< Last encoded frame
+    const int words;
+    const int keyframeInterval;
+    int counter=0; ///< Frames until next keyframe
+};
+
+/**
+ * Frame decoder
+ */
+class FrameDecoder
+{
+public:
+    /**
+     * Constructor
+     * \param words number of words in a frame
+     */
+    explicit FrameDecoder(int words);
+
+    /**
+     * Decode a frame
+     * \param in encoded frame
+     * \param size encoded size in bytes
+     * \param keyframe true if the frame is a keyframe
+     * \param frame decoded frame
+     * \return false if the encoded frame is malformed, or if it is not a
+     * keyframe and the previous frame is not available. The frame can't be
+     * used, and frames can't be decoded until the next keyframe
+     */
+    bool decode(const uint8_t *in, int size, bool keyframe, uint16_t *frame);
+
+    /**
+     * Discard the previous frame, to be called when frames are lost
+     */
+    void invalidate() { valid=false; }
+
+private:
+    FrameDecoder(const FrameDecoder&)=delete;
+    FrameDecoder& operator=(const FrameDecoder&)=delete;
+
+    std::unique_ptr<uint16_t[]> previous; ///< Last decoded frame
+    const int words;
+    bool valid=false; ///< True if previous can be used for delta frames
+};
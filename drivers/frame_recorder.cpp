@@ -0,0 +1,324 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include <cstddef>
+#include <climits>
+#include <algorithm>
+#include <drivers/frame_recorder.h>
+#include <drivers/crc16.h>
+
+using namespace std;
+using namespace miosix;
+
+/// Sectors the eraser keeps erased after the one being written
+static const int eraseAhead=4;
+
+/// Payloads are at most one frame coded in the worst case
+static const int maxRecordSize=sizeof(RecorderRecordHeader)
+    +FrameEncoder::maxEncodedSize(MLX90640Frame::nx*MLX90640Frame::ny);
+
+static_assert(sizeof(RecorderSectorHeader)+maxRecordSize<=recorderSectorSize,
+              "A record must fit in an empty sector");
+
+//
+// class FrameRecorder
+//
+
+FrameRecorder::FrameRecorder() : flash(Flash::instance()),
+    totalSectors((flash.size()-recorderStart)/recorderSectorSize),
+    //Keyframes only when forced, at the start of sectors and sessions
+    encoder(MLX90640Frame::nx*MLX90640Frame::ny,INT_MAX),
+    buffer(new uint8_t[maxRecordSize])
+{
+    mount();
+}
+
+void FrameRecorder::start()
+{
+    writerThread=Thread::create(FrameRecorder::writerThreadMainTramp,2048U,Priority(),static_cast<void*>(this),Thread::JOINABLE);
+    eraserThread=Thread::create(FrameRecorder::eraserThreadMainTramp,2048U,Priority(),static_cast<void*>(this),Thread::JOINABLE);
+}
+
+void FrameRecorder::stop()
+{
+    {
+        Lock<FastMutex> l(m);
+        quit=true;
+        cv.broadcast();
+    }
+    queue.put({nullptr,0});
+    writerThread->join();
+    eraserThread->join();
+}
+
+void FrameRecorder::setRecording(bool enabled)
+{
+    Lock<FastMutex> l(m);
+    recording=enabled;
+    cv.broadcast();
+}
+
+bool FrameRecorder::record(MLX90640Frame *frame, long long timestamp, bool newSession)
+{
+    if(newSession) sessionPending=true;
+    bool success;
+    {
+        FastGlobalIrqLock dLock;
+        success=queue.IRQput({frame,static_cast<uint32_t>(timestamp/1000000)});
+    }
+    if(success==false)
+    {
+        delete frame; //Drop frame without leaking memory
+        Lock<FastMutex> l(m);
+        dropped++;
+    }
+    return success;
+}
+
+FrameRecorder::Status FrameRecorder::status()
+{
+    Lock<FastMutex> l(m);
+    Status result;
+    result.frames=frames;
+    result.dropped=dropped;
+    result.sectors=empty ? 0 : headSequence-tailSequence+1;
+    result.totalSectors=totalSectors;
+    result.session=session;
+    return result;
+}
+
+void *FrameRecorder::writerThreadMainTramp(void *p)
+{
+    static_cast<FrameRecorder *>(p)->writerThreadMain();
+    return nullptr;
+}
+
+void FrameRecorder::writerThreadMain()
+{
+    for(;;)
+    {
+        QueuedFrame q;
+        queue.get(q);
+        if(q.frame==nullptr) break; //Happens on shutdown
+        bool success=writeFrame(q);
+        delete q.frame;
+        Lock<FastMutex> l(m);
+        if(success) frames++; else dropped++;
+    }
+    iprintf("recorderWriterThread min free stack %d\n",
+            MemoryProfiling::getAbsoluteFreeStack());
+}
+
+void *FrameRecorder::eraserThreadMainTramp(void *p)
+{
+    static_cast<FrameRecorder *>(p)->eraserThreadMain();
+    return nullptr;
+}
+
+void FrameRecorder::eraserThreadMain()
+{
+    Lock<FastMutex> l(m);
+    while(quit==false)
+    {
+        if(recording==false || erasedAhead>=eraseAhead)
+        {
+            cv.wait(l);
+            continue;
+        }
+        //The writer only moves to sectors already erased, so it never uses
+        //the one being erased
+        unsigned int addr=nextErase;
+        RecorderSectorHeader header;
+        bool valid;
+        {
+            Unlock<FastMutex> u(l);
+            valid=readSectorHeader(addr,header);
+            flash.eraseSector(addr);
+        }
+        //Overwriting the oldest sector when the FLASH is full
+        if(valid && empty==false && header.sequence==tailSequence) tailSequence++;
+        nextErase=following(addr);
+        erasedAhead++;
+    }
+    iprintf("recorderEraserThread min free stack %d\n",
+            MemoryProfiling::getAbsoluteFreeStack());
+}
+
+void FrameRecorder::mount()
+{
+    unsigned int head=0;
+    for(unsigned int addr=recorderStart;addr<flash.size();addr+=recorderSectorSize)
+    {
+        RecorderSectorHeader header;
+        if(readSectorHeader(addr,header)==false) continue;
+        if(empty || header.sequence>headSequence)
+        {
+            headSequence=header.sequence;
+            head=addr;
+        }
+        if(empty || header.sequence<tailSequence) tailSequence=header.sequence;
+        empty=false;
+    }
+    if(empty)
+    {
+        //Start from the first sector, as if the last one was full
+        sector=flash.size()-recorderSectorSize;
+        writeAddr=sector+recorderSectorSize;
+        puts("Recorder empty");
+    } else {
+        //Find the end of the records in the newest sector. If a record is
+        //corrupted, the sector can't be programmed any further
+        sector=head;
+        const unsigned int end=sector+recorderSectorSize;
+        unsigned int addr=sector+sizeof(RecorderSectorHeader);
+        writeAddr=end;
+        while(addr+sizeof(RecorderRecordHeader)<=end)
+        {
+            auto *header=reinterpret_cast<RecorderRecordHeader*>(buffer.get());
+            if(flash.read(addr,header,sizeof(RecorderRecordHeader))==false) break;
+            if(all_of(buffer.get(),buffer.get()+sizeof(RecorderRecordHeader),
+                      [](uint8_t b){ return b==0xff; }))
+            {
+                writeAddr=addr;
+                break;
+            }
+            unsigned int size=sizeof(RecorderRecordHeader)+header->length;
+            if(addr+size>end || size>maxRecordSize) break;
+            uint16_t crc=header->crc;
+            if(flash.read(addr+sizeof(RecorderRecordHeader),
+                          buffer.get()+sizeof(RecorderRecordHeader),header->length)==false) break;
+            uint16_t actual=crc16Update(crc16Init,header,offsetof(RecorderRecordHeader,crc));
+            actual=crc16Update(actual,buffer.get()+sizeof(RecorderRecordHeader),header->length);
+            if(crc!=actual) break;
+            session=max(session,header->session);
+            addr+=size;
+        }
+        iprintf("Recorder sectors %u to %u, writing @ address 0x%x\n",
+                static_cast<unsigned>(tailSequence),
+                static_cast<unsigned>(headSequence),writeAddr);
+    }
+    nextErase=following(sector);
+}
+
+bool FrameRecorder::writeFrame(const QueuedFrame& q)
+{
+    if(sessionPending)
+    {
+        sessionPending=false;
+        session++;
+        encoder.forceKeyframe();
+    }
+    auto *header=reinterpret_cast<RecorderRecordHeader*>(buffer.get());
+    uint8_t *payload=buffer.get()+sizeof(RecorderRecordHeader);
+    auto *temperature=reinterpret_cast<const uint16_t*>(q.frame->temperature);
+    bool keyframe;
+    int size=encoder.encode(temperature,payload,keyframe);
+    if(writeAddr+sizeof(RecorderRecordHeader)+size>sector+recorderSectorSize)
+    {
+        if(nextSector()==false)
+        {
+            //The next frame can't be a delta from this one
+            encoder.forceKeyframe();
+            return false;
+        }
+        size=encoder.encode(temperature,payload,keyframe);
+    }
+    header->timestamp=q.timestamp;
+    header->length=size;
+    header->flags=keyframe ? recorderKeyframe : 0;
+    header->reserved=0xff;
+    header->session=session;
+    header->crc=crc16Update(crc16Init,header,offsetof(RecorderRecordHeader,crc));
+    header->crc=crc16Update(header->crc,payload,size);
+    size+=sizeof(RecorderRecordHeader);
+    if(program(writeAddr,buffer.get(),size)==false)
+    {
+        //Partially programmed, continue in a new sector
+        iprintf("Failed to record @ address 0x%x\n",writeAddr);
+        writeAddr=sector+recorderSectorSize;
+        encoder.forceKeyframe();
+        return false;
+    }
+    writeAddr+=size;
+    return true;
+}
+
+bool FrameRecorder::nextSector()
+{
+    RecorderSectorHeader header;
+    {
+        Lock<FastMutex> l(m);
+        if(erasedAhead==0)
+        {
+            puts("Recorder eraser overrun");
+            return false;
+        }
+        erasedAhead--;
+        cv.signal();
+        sector=following(sector);
+        header.sequence=empty ? 0 : headSequence+1;
+        headSequence=header.sequence;
+        if(empty) tailSequence=header.sequence;
+        empty=false;
+    }
+    header.magic=recorderMagic;
+    header.reserved=0xffff;
+    header.crc=crc16Update(crc16Init,&header,offsetof(RecorderSectorHeader,crc));
+    writeAddr=sector+sizeof(RecorderSectorHeader);
+    encoder.forceKeyframe();
+    if(program(sector,&header,sizeof(header))) return true;
+    iprintf("Failed to write sector header @ address 0x%x\n",sector);
+    writeAddr=sector+recorderSectorSize;
+    return false;
+}
+
+bool FrameRecorder::program(unsigned int addr, const void *data, int size)
+{
+    auto *p=static_cast<const uint8_t*>(data);
+    while(size>0)
+    {
+        int chunk=min<int>(size,flash.pageSize()-addr%flash.pageSize());
+        if(flash.write(addr,p,chunk)==false) return false;
+        addr+=chunk;
+        p+=chunk;
+        size-=chunk;
+    }
+    return true;
+}
+
+bool FrameRecorder::readSectorHeader(unsigned int addr, RecorderSectorHeader& header)
+{
+    if(flash.read(addr,&header,sizeof(header))==false) return false;
+    return header.magic==recorderMagic &&
+           header.crc==crc16Update(crc16Init,&header,offsetof(RecorderSectorHeader,crc));
+}
+
+unsigned int FrameRecorder::following(unsigned int sector) const
+{
+    sector+=recorderSectorSize;
+    return sector<flash.size() ? sector : recorderStart;
+}
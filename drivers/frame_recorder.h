@@ -0,0 +1,229 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Recording of processed frames to FLASH, as a log-structured ring buffer of
+ * 4KByte sectors after the first MByte, which is left for the options and the
+ * snapshots (snapshot_store.h). All fields are little endian.
+ *
+ * Each sector in use starts with a RecorderSectorHeader, whose sequence
+ * number is one more than that of the previously written sector, so the
+ * newest and oldest sectors are found by scanning the headers. Records
+ * follow, each made of a RecorderRecordHeader and length bytes of payload,
+ * until a header that is all 0xff (unprogrammed FLASH) or one whose CRC does
+ * not match, left by a power loss while writing. Records never span sectors.
+ *
+ * The payload is the 32*24 temperatures of an MLX90640Frame coded with
+ * FrameEncoder (frame_codec.h). The first record of a sector and of a
+ * recording session is a keyframe, so each sector can be decoded on its own
+ * after older sectors are overwritten.
+ */
+
+const uint32_t recorderStart=1024*1024;     ///< First FLASH address used
+const uint32_t recorderSectorSize=4*1024;   ///< FLASH sector size
+const uint32_t recorderMagic=0x43455254;    ///< "TREC"
+const uint8_t recorderKeyframe=1<<0;        ///< Record flag, payload is a keyframe
+
+/**
+ * Written at the start of each sector before its first record
+ */
+struct RecorderSectorHeader
+{
+    uint32_t magic;    ///< recorderMagic
+    uint32_t sequence; ///< Incremented for each new sector
+    uint16_t reserved; ///< 0xffff
+    uint16_t crc;      ///< crc16Update() of the previous fields
+};
+
+/**
+ * Precedes each recorded frame
+ */
+struct RecorderRecordHeader
+{
+    uint32_t timestamp; ///< Frame time in milliseconds since boot
+    uint16_t length;    ///< Payload size in bytes
+    uint8_t flags;      ///< recorderKeyframe
+    uint8_t reserved;   ///< 0xff
+    uint16_t session;   ///< Incremented each time recording is started
+    uint16_t crc;       ///< crc16Update() of the previous fields and the payload
+};
+
+static_assert(sizeof(RecorderSectorHeader)==12, "Unexpected padding");
+static_assert(sizeof(RecorderRecordHeader)==12, "Unexpected padding");
+
+#ifdef _MIOSIX
+
+#include <memory>
+#include <miosix.h>
+#include <drivers/mlx90640frame.h>
+#include <drivers/frame_codec.h>
+#include <drivers/flash.h>
+
+/**
+ * Records frames to FLASH from a background thread. While recording is
+ * enabled, sectors are erased ahead of the write position by another thread,
+ * so moving to a new sector never waits for the ~60ms sector erase. Nothing
+ * is erased while recording is disabled, so old recordings are kept. As the
+ * FLASH can't be programmed while erasing, a frame arriving during an erase
+ * waits in the queue. Frames are dropped, never blocking the caller, if the
+ * queue is full or the eraser falls behind.
+ */
+class FrameRecorder
+{
+public:
+    /**
+     * Constructor, scans the FLASH to find where the previous recording ended
+     */
+    FrameRecorder();
+
+    /**
+     * Start the recorder threads
+     */
+    void start();
+
+    /**
+     * Stop the recorder threads, waiting for the queued frame to be written
+     */
+    void stop();
+
+    /**
+     * Enable or disable erasing sectors ahead of the write position. Must be
+     * enabled before recording frames, and it is disabled at boot
+     * \param enabled true while recording
+     */
+    void setRecording(bool enabled);
+
+    /**
+     * Queue a frame for recording, without blocking
+     * \param frame frame to record, ownership is transferred
+     * \param timestamp frame time in nanoseconds since boot
+     * \param newSession true for the first frame after recording is started
+     * \return false if the frame was dropped as the previous one is still
+     * being written
+     */
+    bool record(MLX90640Frame *frame, long long timestamp, bool newSession);
+
+    /**
+     * Recorder state, for display and remote control
+     */
+    struct Status
+    {
+        int frames;        ///< Frames recorded since boot
+        int dropped;       ///< Frames dropped since boot
+        int sectors;       ///< Sectors containing recorded frames
+        int totalSectors;  ///< Sectors available for recording
+        int session;       ///< Current or last recording session
+    };
+
+    /**
+     * \return the recorder state
+     */
+    Status status();
+
+private:
+    FrameRecorder(const FrameRecorder&)=delete;
+    FrameRecorder& operator=(const FrameRecorder&)=delete;
+
+    /// Frame waiting to be written, with its timestamp in milliseconds
+    struct QueuedFrame
+    {
+        MLX90640Frame *frame;
+        uint32_t timestamp;
+    };
+
+    static void *writerThreadMainTramp(void *p);
+    void writerThreadMain();
+
+    static void *eraserThreadMainTramp(void *p);
+    void eraserThreadMain();
+
+    /**
+     * Scan the sector headers and the records of the newest sector
+     */
+    void mount();
+
+    /**
+     * Write a frame, moving to a new sector if it does not fit
+     * \return false if dropped or on write errors
+     */
+    bool writeFrame(const QueuedFrame& q);
+
+    /**
+     * Move to the next sector, if the eraser already erased it, and write
+     * its header
+     * \return false if the next sector is not erased yet
+     */
+    bool nextSector();
+
+    /**
+     * Write data across page boundaries
+     */
+    bool program(unsigned int addr, const void *data, int size);
+
+    /**
+     * \return true if a valid sector header was read
+     */
+    bool readSectorHeader(unsigned int addr, RecorderSectorHeader& header);
+
+    /**
+     * \return the address of the sector after the given one, wrapping around
+     */
+    unsigned int following(unsigned int sector) const;
+
+    Flash& flash;
+    const int totalSectors;
+    miosix::Queue<QueuedFrame,1> queue;
+    miosix::Thread *writerThread=nullptr;
+    miosix::Thread *eraserThread=nullptr;
+    FrameEncoder encoder;
+    std::unique_ptr<uint8_t[]> buffer; ///< Record being written
+
+    //Written only by the writer thread
+    unsigned int sector;       ///< Sector being written
+    unsigned int writeAddr;    ///< Where the next record goes
+    uint16_t session=0;
+    volatile bool sessionPending=false; ///< Next frame starts a new session
+
+    //Shared between threads, protected by m
+    miosix::FastMutex m;
+    miosix::ConditionVariable cv;
+    unsigned int nextErase;     ///< Next sector the eraser will erase
+    int erasedAhead=0;          ///< Erased sectors after the current one
+    uint32_t headSequence=0;    ///< Sequence number of the newest sector
+    uint32_t tailSequence=0;    ///< Sequence number of the oldest sector
+    bool empty=true;            ///< No sector with a valid header
+    bool recording=false;       ///< Sectors are erased ahead only if true
+    bool quit=false;
+    int frames=0;
+    int dropped=0;
+};
+
+#endif //_MIOSIX
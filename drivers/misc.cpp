@@ -31,12 +31,32 @@
 
 using namespace miosix;
 
+static const int batterySamples=16; ///< Oversampling of battery measurement
+static unsigned short batterySampleBuffer[batterySamples];
+static Thread *adcWaiting=nullptr;
+
+/**
+ * DMA end of transfer of the battery voltage samples
+ */
+static void adcDmaHandler()
+{
+    DMA2->LIFCR=DMA_LIFCR_CTCIF0
+              | DMA_LIFCR_CHTIF0
+              | DMA_LIFCR_CTEIF0
+              | DMA_LIFCR_CDMEIF0
+              | DMA_LIFCR_CFEIF0;
+    if(adcWaiting) adcWaiting->IRQwakeup();
+    adcWaiting=nullptr;
+}
+
 void initializeBoard()
 {
     {
-        FastGlobalIrqLock dLock;
+        GlobalIrqLock dLock;
         RCC->APB2ENR |= RCC_APB2ENR_ADC1EN;
+        RCC->AHB1ENR |= RCC_AHB1ENR_DMA2EN;
         RCC_SYNC();
+        IRQregisterIrq(dLock,DMA2_Stream0_IRQn,&adcDmaHandler);
         up_btn::mode(Mode::INPUT_PULL_UP);
         on_btn::mode(Mode::INPUT_PULL_DOWN);
         keep_on::mode(Mode::OUTPUT);
@@ -60,23 +80,91 @@ void shutdownBoard()
     for(;;) Thread::sleep(1);
 }
 
-int getBatteryVoltage()
+static Thread *buttonWaiting=nullptr;
+static bool buttonEvent=false;
+
+/**
+ * Edge interrupt of both buttons
+ */
+static void buttonIrqHandler()
+{
+    EXTI->PR=EXTI_PR_PR10 | EXTI_PR_PR11;
+    buttonEvent=true;
+    if(buttonWaiting) buttonWaiting->IRQwakeup();
+    buttonWaiting=nullptr;
+}
+
+void enableButtonInterrupts()
+{
+    GlobalIrqLock dLock;
+    RCC->APB2ENR |= RCC_APB2ENR_SYSCFGEN;
+    RCC_SYNC();
+    //up_btn is PC10, on_btn is PC11, both edges
+    SYSCFG->EXTICR[2]=(SYSCFG->EXTICR[2]
+                    & ~(SYSCFG_EXTICR3_EXTI10 | SYSCFG_EXTICR3_EXTI11))
+                    | SYSCFG_EXTICR3_EXTI10_PC
+                    | SYSCFG_EXTICR3_EXTI11_PC;
+    EXTI->RTSR |= EXTI_RTSR_TR10 | EXTI_RTSR_TR11;
+    EXTI->FTSR |= EXTI_FTSR_TR10 | EXTI_FTSR_TR11;
+    EXTI->PR=EXTI_PR_PR10 | EXTI_PR_PR11;
+    EXTI->IMR |= EXTI_IMR_MR10 | EXTI_IMR_MR11;
+    IRQregisterIrq(dLock,EXTI15_10_IRQn,&buttonIrqHandler);
+}
+
+bool waitForButtonEvent(long long absoluteTime)
+{
+    FastGlobalIrqLock dLock;
+    while(buttonEvent==false)
+    {
+        buttonWaiting=Thread::getCurrentThread();
+        auto result=Thread::IRQglobalIrqUnlockAndTimedWait(dLock,absoluteTime);
+        if(result==TimedWaitResult::Timeout && buttonEvent==false)
+        {
+            buttonWaiting=nullptr;
+            return false;
+        }
+    }
+    buttonEvent=false;
+    return true;
+}
+
+int getBatteryMillivolts()
 {
+    ADC1->SR=0; //Clear overrun left by the previous measurement
     ADC1->CR2=ADC_CR2_ADON; //Turn ADC ON
     delayUs(3); //Power up time
-    ADC1->CR2 |= ADC_CR2_SWSTART; //Start conversion
-    while((ADC1->SR & ADC_SR_EOC)==0) ; //Wait for conversion
-    int result=ADC1->DR; //Read result
+    adcWaiting=Thread::getCurrentThread();
+    DMA2_Stream0->CR=0;
+    DMA2_Stream0->PAR=reinterpret_cast<unsigned int>(&ADC1->DR);
+    DMA2_Stream0->M0AR=reinterpret_cast<unsigned int>(batterySampleBuffer);
+    DMA2_Stream0->NDTR=batterySamples;
+    DMA2_Stream0->FCR=0;
+    DMA2_Stream0->CR=DMA_SxCR_MSIZE_0 //Memory size 16 bit
+                   | DMA_SxCR_PSIZE_0 //Peripheral size 16 bit
+                   | DMA_SxCR_MINC    //Increment memory pointer
+                   | DMA_SxCR_TCIE    //Interrupt on transfer complete
+                   | DMA_SxCR_TEIE    //Interrupt on transfer error
+                   | DMA_SxCR_EN;     //Start DMA, channel 0 is ADC1
+    //Continuous conversions, stopped by turning the ADC off when done
+    ADC1->CR2=ADC_CR2_ADON | ADC_CR2_CONT | ADC_CR2_DMA;
+    ADC1->CR2 |= ADC_CR2_SWSTART;
+    {
+        FastGlobalIrqLock dLock;
+        while(adcWaiting) Thread::IRQglobalIrqUnlockAndWait(dLock);
+    }
     ADC1->CR2=0; //Turn ADC OFF
-    //return the voltage in V multiplied by 10, so 40=4V
-    return result/62; //4096/2/Vcc/10=62, Vcc=3.3V
+    DMA2_Stream0->CR=0;
+    int sum=0;
+    for(int i=0;i<batterySamples;i++) sum+=batterySampleBuffer[i];
+    //12 bit ADC, Vcc=3.3V, battery voltage halved by a resistor divider
+    return sum*2*3300/(4096*batterySamples);
 }
 
-BatteryLevel batteryLevel(int voltage)
+BatteryLevel batteryLevel(int millivolts)
 {
-    if(voltage>38) return BatteryLevel::B100;
-    if(voltage>37) return BatteryLevel::B75;
-    if(voltage>36) return BatteryLevel::B50;
-    if(voltage>35) return BatteryLevel::B25;
+    if(millivolts>=3900) return BatteryLevel::B100;
+    if(millivolts>=3800) return BatteryLevel::B75;
+    if(millivolts>=3700) return BatteryLevel::B50;
+    if(millivolts>=3600) return BatteryLevel::B25;
     return BatteryLevel::B0;
 }
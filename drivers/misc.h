@@ -38,10 +38,25 @@ void initializeBoard();
 void shutdownBoard();
 
 /**
+ * Enable the button edge interrupts used by waitForButtonEvent()
+ */
+void enableButtonInterrupts();
+
+/**
+ * Wait until a button changes state, or a timeout expires.
+ * NOTE: not reentrant, call this function from one thread only
+ * \param absoluteTime absolute time in nanoseconds when to stop waiting
+ * \return true if a button changed state, false on timeout
+ */
+bool waitForButtonEvent(long long absoluteTime);
+
+/**
+ * Measure the battery voltage, averaging a burst of ADC samples transferred
+ * by DMA. The calling thread sleeps while the conversions take place.
  * NOTE: not reentrant, call this function from one thread only
- * \return battery voltage in tenths of volt, i.e. 42 is 4.2V
+ * \return battery voltage in millivolts
  */
-int getBatteryVoltage();
+int getBatteryMillivolts();
 
 /**
  * Battery charge status
@@ -57,7 +72,7 @@ enum class BatteryLevel
 
 /**
  * Convert battery voltage to approximate battery charge status
- * \param voltage battery voltage in tenths of volt, i.e.42 is 4.2V
+ * \param millivolts battery voltage in millivolts
  * \return battery charge status
  */
-BatteryLevel batteryLevel(int voltage);
+BatteryLevel batteryLevel(int millivolts);
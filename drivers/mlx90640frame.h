@@ -29,6 +29,24 @@
 
 #include "MLX90640_API.h"
 
+/**
+ * Statistics of a processed MLX90640 frame. Temperatures are scaled by
+ * MLX90640Frame::scaleFactor, and pixel indices refer to
+ * MLX90640Frame::temperature
+ */
+class MLX90640FrameStats
+{
+public:
+    short minTemp;        ///< Minimum temperature
+    short maxTemp;        ///< Maximum temperature
+    short meanTemp;       ///< Mean temperature, rounded
+    short crosshairTemp;  ///< Temperature of the center pixel
+    unsigned short argMin; ///< Index of the pixel with the minimum temperature
+    unsigned short argMax; ///< Index of the pixel with the maximum temperature
+    /// Coarse histogram, see statsHistogramBase and statsHistogramShift
+    unsigned short histogram[statsHistogramBins];
+};
+
 /**
  * Processed MLX90640 frame with temperature data. Temperature is stored
  * as an array of short, one per pixel, which contain the temperature in
@@ -43,6 +61,7 @@ public:
     static const int nx=32, ny=24; ///< Image resolution
     static const int scaleFactor=::scaleFactor; ///< Temperature scale factor
     short temperature[nx*ny]; // Heavy object! 1.5 KByte
+    MLX90640FrameStats stats; ///< Computed while processing the frame
     
     /**
      * \param x x coordinate
@@ -51,6 +70,49 @@ public:
      * point, compensating for the sensor orientation on the board
      */
     short getTempAt(int x, int y) { return temperature[(nx-1-x)+y*nx]; }
+
+    /**
+     * \param index index into the temperature array
+     * \return the x coordinate of the pixel, in the same coordinate system as
+     * getTempAt()
+     */
+    static int xOf(int index) { return nx-1-index%nx; }
+
+    /**
+     * \param index index into the temperature array
+     * \return the y coordinate of the pixel, in the same coordinate system as
+     * getTempAt()
+     */
+    static int yOf(int index) { return index/nx; }
+
+    /**
+     * Compute the statistics from the temperature array. Only needed for
+     * frames that were not produced by MLX90640RawFrame::process(), which
+     * computes them while processing the pixels
+     */
+    void computeStats()
+    {
+        statsMLX90640 s;
+        MLX90640_ResetStats(&s);
+        for(int i=0;i<nx*ny;i++) MLX90640_AccumulateStats(&s,temperature[i],i);
+        setStats(s);
+    }
+
+    /**
+     * Finalize the statistics of the frame
+     * \param s statistics accumulated over all pixels of the frame
+     */
+    void setStats(const statsMLX90640& s)
+    {
+        stats.minTemp=s.minTemp;
+        stats.maxTemp=s.maxTemp;
+        int sum=s.sum+(s.sum>=0 ? nx*ny/2 : -nx*ny/2);
+        stats.meanTemp=sum/(nx*ny);
+        stats.crosshairTemp=getTempAt(nx/2,ny/2);
+        stats.argMin=s.argMin;
+        stats.argMax=s.argMax;
+        for(int i=0;i<statsHistogramBins;i++) stats.histogram[i]=s.histogram[i];
+    }
 };
 
 /**
@@ -70,6 +132,7 @@ class MLX90640RawFrame
 {
 public:
     unsigned short subframe[2][834]; // Heavy object! ~3.4 KByte
+    long long timestamp=0; ///< When the frame was read, in ns
 
     /**
      * Processes this raw frame, computing the themperature of each pixel.
@@ -85,12 +148,17 @@ public:
     void process(MLX90640Frame *output, paramsMLX90640& params, float emissivity) const
     {
         const float taShift=8.f; //Default shift for MLX90640 in open air
+        //Each subframe computes half of the pixels, and accumulates their
+        //statistics, which are merged into the frame when both are done
+        statsMLX90640 stats;
+        MLX90640_ResetStats(&stats);
         for(int i=0;i<2;i++)
         {
             float vdd=MLX90640_GetVdd(this->subframe[i],&params);
             float Ta=MLX90640_GetTa(this->subframe[i],&params,vdd);
             float Tr=Ta-taShift; //Reflected temperature based on the sensor ambient temperature
-            MLX90640_CalculateToShort(this->subframe[i],&params,emissivity,vdd,Ta,Tr,output->temperature);
+            MLX90640_CalculateToShort(this->subframe[i],&params,emissivity,vdd,Ta,Tr,output->temperature,&stats);
         }
+        output->setStats(stats);
     }
 };
@@ -26,113 +26,327 @@
  ***************************************************************************/
 
 #include <cstring>
+#include <cstddef>
 #include <cassert>
+#include <cstdio>
 #include <memory>
+#include <mutex>
+#include <algorithm>
 #include <drivers/options_save.h>
 #include <drivers/flash.h>
-#include <util/crc16.h>
-#include <util/util.h>
+#include <drivers/crc16.h>
 
 using namespace std;
-using namespace miosix;
 
 struct Header
+{
+    unsigned char written;   //0x00 if written, 0xff if not written
+    unsigned char type;      //Record type
+    unsigned char version;   //Schema version of the data
+    unsigned char size;      //Data size in bytes
+    unsigned short sequence; //Higher than that of all older records
+    unsigned short crc;      //Of the previous fields and the data
+};
+
+/**
+ * Header of the records written by firmware predating record types, which
+ * used only the first sector and did not store the data size
+ */
+struct LegacyHeader
 {
     unsigned char written;     //0x00 if written,     0xff if not written
     unsigned char invalidated; //0x00 if invalidated, 0xff if not invalidated
-    unsigned short crc;
+    unsigned short crc;        //Of the data
 };
 
-void loadOptions(void *options, int optionsSize)
+static const unsigned int sectors[]={0,4*1024}; //Used alternately
+static const unsigned int none=0xffffffff;
+
+/**
+ * Cached result of the FLASH scan
+ */
+struct OptionsCache
 {
-    puts("loadOptions");
-    auto& flash=Flash::instance();
+    bool scanned=false;
+    int active;              //Index into sectors[] being appended to
+    unsigned int nextFree;   //Next free slot in the active sector, or none
+    unsigned short sequence; //Of the newest record
+    unsigned int newest[maxOptionsTypes]; //Newest record of each type, or none
+    bool legacy;             //newest[0] is a record written by older firmware
+};
 
-    unsigned int size=optionsSize+sizeof(Header);
-    assert(size<flash.pageSize());
-    auto buffer=make_unique<unsigned char[]>(size);
-    auto *header=reinterpret_cast<Header*>(buffer.get());
+static OptionsCache cache;
+static mutex cacheMutex;
+
+/**
+ * \return true if sequence number a is more recent than b
+ */
+static bool newer(unsigned short a, unsigned short b)
+{
+    return static_cast<short>(a-b)>0;
+}
 
-    for(unsigned int i=0;i<flash.sectorSize();i+=flash.pageSize())
+/**
+ * Convert a valid record written by firmware predating record types into a
+ * type 0, version 0 record with sequence number 0, so that it can be loaded
+ * and compacted as any other record
+ * \param buffer one page buffer with the record
+ * \return true if it is a valid legacy record
+ */
+static bool convertLegacyRecord(unsigned char *buffer)
+{
+    auto& flash=Flash::instance();
+    auto *legacy=reinterpret_cast<LegacyHeader*>(buffer);
+    auto *header=reinterpret_cast<Header*>(buffer);
+    if(legacy->written!=0 || legacy->invalidated!=0xff) return false;
+    //The data size is not stored, but the rest of the page is not programmed,
+    //so it is found by adding the trailing 0xff bytes until the CRC matches
+    unsigned char *data=buffer+sizeof(LegacyHeader);
+    int maxSize=flash.pageSize()-sizeof(Header);
+    int size=flash.pageSize()-sizeof(LegacyHeader);
+    while(size>0 && data[size-1]==0xff) size--;
+    if(size>maxSize) return false;
+    unsigned short crc=crc16Update(crc16Init,data,size);
+    while(crc!=legacy->crc)
     {
-        if(flash.read(i,buffer.get(),size)==false)
-        {
-            iprintf("Failed to read address 0x%x\n",i);
-            break; //Read error, abort
-        }
-        //memDump(buffer.get(),size);
-        if(header->written!=0)
-        {
-            iprintf("Unwritten option @ address 0x%x\n",i);
-            break; //Reached unwritten, abort
-        }
-        if(header->invalidated==0)
-        {
-            iprintf("Invalidated option @ address 0x%x\n",i);
-            continue; //Skip invalidated entry
-        }
-        if(header->crc!=crc16(buffer.get()+sizeof(Header),optionsSize))
-        {
-            iprintf("Corrupted option @ address 0x%x\n",i);
-            continue; //Corrupted
-        }
-        memcpy(options,buffer.get()+sizeof(Header),optionsSize);
-        iprintf("Loaded options from address 0x%x\n",i);
-        break;
+        if(size==maxSize) return false;
+        crc=crc16Update(crc,data+size++,1);
     }
+    memmove(buffer+sizeof(Header),data,size);
+    header->written=0;
+    header->type=0;
+    header->version=0;
+    header->size=size;
+    header->sequence=0;
+    header->crc=crc16Update(crc16Init,header,offsetof(Header,crc));
+    header->crc=crc16Update(header->crc,buffer+sizeof(Header),size);
+    return true;
 }
 
-void saveOptions(void *options, int optionsSize)
+/**
+ * Read and validate the record in a slot
+ * \param addr slot address
+ * \param buffer one page buffer
+ * \return 1 if valid, 2 if valid and written by older firmware, 0 if free,
+ * -1 if not valid
+ */
+static int readRecord(unsigned int addr, unsigned char *buffer)
 {
-    puts("saveOptions");
     auto& flash=Flash::instance();
+    auto *header=reinterpret_cast<Header*>(buffer);
+    if(flash.read(addr,buffer,flash.pageSize())==false)
+    {
+        iprintf("Failed to read address 0x%x\n",addr);
+        return -1;
+    }
+    if(all_of(buffer,buffer+flash.pageSize(),[](unsigned char c){ return c==0xff; }))
+        return 0;
+    if(addr<sectors[0]+flash.sectorSize() && convertLegacyRecord(buffer)) return 2;
+    if(header->written!=0 || header->type>=maxOptionsTypes
+        || sizeof(Header)+header->size>flash.pageSize())
+        return -1;
+    unsigned short crc=crc16Update(crc16Init,header,offsetof(Header,crc));
+    crc=crc16Update(crc,buffer+sizeof(Header),header->size);
+    return crc==header->crc ? 1 : -1;
+}
 
-    unsigned int size=optionsSize+sizeof(Header);
-    assert(size<flash.pageSize());
-    auto buffer=make_unique<unsigned char[]>(size);
-    auto *header=reinterpret_cast<Header*>(buffer.get());
-
-    int found=-1;
-    for(unsigned int i=0;i<flash.sectorSize();i+=flash.pageSize())
+/**
+ * Find the newest record of each type and where to append the next one.
+ * Requires cacheMutex to be locked
+ */
+static void scan(unsigned char *buffer)
+{
+    puts("Scanning options");
+    auto& flash=Flash::instance();
+    auto *header=reinterpret_cast<Header*>(buffer);
+    //Newest record of each type and newest sequence number, for each sector
+    unsigned int newest[2][maxOptionsTypes];
+    unsigned short newestSequence[2][maxOptionsTypes];
+    unsigned short sequence[2];
+    bool found[2]={false,false};
+    unsigned int end[2]; //After the last slot in use, for each sector
+    unsigned int legacy=none;
+    for(int s=0;s<2;s++)
     {
-        if(flash.read(i,buffer.get(),size)==false)
-        {
-            iprintf("Failed to read address 0x%x\n",i);
-            return;
-        }
-        if(header->invalidated==0) continue;
-        if(header->written==0)
+        for(auto& n : newest[s]) n=none;
+        end[s]=sectors[s];
+        for(unsigned int i=0;i<flash.sectorSize();i+=flash.pageSize())
         {
-            //Found valid written data
-            if(memcmp(buffer.get()+sizeof(Header),options,optionsSize)==0)
+            unsigned int addr=sectors[s]+i;
+            int result=readRecord(addr,buffer);
+            if(result==0) continue;
+            end[s]=addr+flash.pageSize(); //Records are appended, never reuse
+            if(result<0)
+            {
+                iprintf("Corrupted option @ address 0x%x\n",addr);
+                continue;
+            }
+            if(result==2)
+            {
+                legacy=addr; //Older firmware kept only one valid record
+                continue;
+            }
+            //On equal sequence numbers the record at the higher address wins
+            int t=header->type;
+            if(newest[s][t]==none || newer(newestSequence[s][t],header->sequence)==false)
             {
-                puts("Options did not change, not saving");
-                return;
+                newest[s][t]=addr;
+                newestSequence[s][t]=header->sequence;
             }
-            //And it differs, invalidate
-            iprintf("Invalidating entry @ address 0x%x\n",i);
-            header->invalidated=0;
-            if(flash.write(i,buffer.get(),sizeof(Header))==false)
+            if(found[s]==false || newer(sequence[s],header->sequence)==false)
             {
-                iprintf("Failed to invalidate address 0x%x\n",i);
-                return;
+                sequence[s]=header->sequence;
+                found[s]=true;
             }
-            continue;
         }
-        //Not invalidated and not written, we found one sector
-        found=i;
-        break;
     }
-    if(found==-1)
+
+    //Compacting copies records with their sequence number, so until the next
+    //record is saved both sectors have the same newest one. The sector
+    //compacted to is the one that is not full
+    int a=0;
+    if(found[1] && (found[0]==false || newer(sequence[1],sequence[0])
+        || (sequence[1]==sequence[0] && end[1]<sectors[1]+flash.sectorSize())))
+        a=1;
+    cache.active=a;
+    cache.sequence=found[a] ? sequence[a] : 0;
+    for(int t=0;t<maxOptionsTypes;t++)
+    {
+        //The copy in the active sector wins, the other sector has the records
+        //not copied yet if compacting was interrupted
+        unsigned int o=newest[a^1][t];
+        if(newest[a][t]==none || (o!=none
+            && newer(newestSequence[a^1][t],newestSequence[a][t])))
+            cache.newest[t]=o;
+        else cache.newest[t]=newest[a][t];
+    }
+    //A legacy record is valid only if nothing was saved by this firmware, as
+    //garbage left by an interrupted erase may pass the legacy validation, as
+    //its size is not stored
+    cache.legacy=found[0]==false && found[1]==false && legacy!=none;
+    if(cache.legacy) cache.newest[0]=legacy;
+    unsigned int sectorEnd=sectors[a]+flash.sectorSize();
+    cache.nextFree=end[a]<sectorEnd ? end[a] : none;
+    cache.scanned=true;
+}
+
+/**
+ * Erase the other sector and copy there the newest record of each type
+ * except one, which is about to be saved. Requires cacheMutex to be locked
+ * \param skip type not to copy
+ * \return true on success
+ */
+static bool compact(int skip)
+{
+    auto& flash=Flash::instance();
+    int other=cache.active^1;
+    //The records are read before erasing, as some may be in the other sector
+    //if the previous compaction was interrupted
+    auto buffer=make_unique<unsigned char[]>(maxOptionsTypes*flash.pageSize());
+    int types[maxOptionsTypes];
+    int count=0;
+    for(int t=0;t<maxOptionsTypes;t++)
+    {
+        if(t==skip || cache.newest[t]==none) continue;
+        if(readRecord(cache.newest[t],buffer.get()+count*flash.pageSize())<=0)
+            return false;
+        types[count++]=t;
+    }
+    iprintf("Compacting options to address 0x%x\n",sectors[other]);
+    flash.eraseSector(sectors[other]);
+    unsigned int addr=sectors[other];
+    for(int i=0;i<count;i++)
     {
-        puts("All entries full, erasing sector 0");
-        flash.eraseSector(0);
-        found=0;
+        //Copied unchanged, sequence number included
+        unsigned char *record=buffer.get()+i*flash.pageSize();
+        auto *header=reinterpret_cast<Header*>(record);
+        if(flash.write(addr,record,sizeof(Header)+header->size)==false)
+            return false;
+        cache.newest[types[i]]=addr;
+        addr+=flash.pageSize();
+    }
+    cache.active=other;
+    cache.nextFree=addr;
+    cache.legacy=false;
+    return true;
+}
+
+bool loadOptions(int type, int version, void *options, int optionsSize)
+{
+    puts("loadOptions");
+    auto& flash=Flash::instance();
+    assert(type>=0 && type<maxOptionsTypes);
+    assert(optionsSize+sizeof(Header)<=flash.pageSize());
+    auto buffer=make_unique<unsigned char[]>(flash.pageSize());
+    auto *header=reinterpret_cast<Header*>(buffer.get());
+
+    lock_guard<mutex> l(cacheMutex);
+    if(cache.scanned==false) scan(buffer.get());
+    unsigned int addr=cache.newest[type];
+    if(addr==none || readRecord(addr,buffer.get())<=0)
+    {
+        puts("No options found");
+        return false;
+    }
+    if(header->version!=version)
+    {
+        iprintf("Options @ address 0x%x have version %d\n",addr,header->version);
+        return false;
+    }
+    //Fields appended after saving keep their default value
+    memcpy(options,buffer.get()+sizeof(Header),min<int>(header->size,optionsSize));
+    iprintf("Loaded options from address 0x%x\n",addr);
+    return true;
+}
+
+bool saveOptions(int type, int version, const void *options, int optionsSize)
+{
+    puts("saveOptions");
+    auto& flash=Flash::instance();
+    assert(type>=0 && type<maxOptionsTypes);
+    assert(optionsSize+sizeof(Header)<=flash.pageSize());
+    auto buffer=make_unique<unsigned char[]>(flash.pageSize());
+    auto *header=reinterpret_cast<Header*>(buffer.get());
+
+    lock_guard<mutex> l(cacheMutex);
+    if(cache.scanned==false) scan(buffer.get());
+    unsigned int addr=cache.newest[type];
+    if(addr!=none && readRecord(addr,buffer.get())>0 && header->version==version
+        && header->size==optionsSize
+        && memcmp(buffer.get()+sizeof(Header),options,optionsSize)==0)
+    {
+        puts("Options did not change, not saving");
+        return true;
+    }
+
+    //Older records are not invalidated, the sequence number supersedes them.
+    //Legacy records are converted by compacting before the first save, as
+    //they are no longer valid once another record is saved
+    if((cache.nextFree==none || cache.legacy) && compact(type)==false)
+    {
+        puts("Failed compacting options");
+        cache.scanned=false; //Find out what is left at the next access
+        return false;
     }
     header->written=0;
-    header->invalidated=0xff;
-    header->crc=crc16(options,optionsSize);
+    header->type=type;
+    header->version=version;
+    header->size=optionsSize;
+    header->sequence=cache.sequence+1;
+    header->crc=crc16Update(crc16Init,header,offsetof(Header,crc));
+    header->crc=crc16Update(header->crc,options,optionsSize);
     memcpy(buffer.get()+sizeof(Header),options,optionsSize);
-    iprintf("Writing options @ address 0x%x\n",found);
-    if(flash.write(found,buffer.get(),size)==false) puts("Failed writing options");
+    addr=cache.nextFree;
+    iprintf("Writing options @ address 0x%x\n",addr);
+    if(flash.write(addr,buffer.get(),sizeof(Header)+optionsSize)==false)
+    {
+        puts("Failed writing options");
+        cache.scanned=false;
+        return false;
+    }
+    cache.newest[type]=addr;
+    cache.sequence=header->sequence;
+    addr+=flash.pageSize();
+    cache.nextFree=addr<sectors[cache.active]+flash.sectorSize() ? addr : none;
+    return true;
 }
@@ -27,19 +27,45 @@
 
 #pragma once
 
+/*
+ * Options are saved in the first two FLASH sectors, as records of up to one
+ * page. Each record has a type, so several kinds of options can be stored,
+ * and a schema version. Records are appended, and the one with the highest
+ * sequence number for each type supersedes older ones, which are erased only
+ * when the sector is full and the newest records are compacted into the other
+ * sector. The location of the newest record of each type and of the next free
+ * slot are cached after the first scan, so saving is a single page program.
+ * Options saved by firmware predating record types are loaded as type 0,
+ * version 0, and the first save converts them to the new format.
+ */
+
+/// Number of record types, types go from 0 to maxOptionsTypes-1
+const int maxOptionsTypes=4;
+
 /**
  * Try to load valid options from FLASH
  * If no valid options found, the options pointer is not modified. This is
  * deliberate as it allows to have the options pointer pre-initialized to
- * default values.
+ * default values. For the same reason, if the saved options are smaller than
+ * optionsSize, as fields were appended to the data structure after saving
+ * them, the remaining bytes are not modified. Data structures whose fields
+ * are changed in other ways need a new version. Options saved with an older
+ * version can be loaded passing that version and a data structure with the
+ * old layout, to convert them.
+ * \param type record type
+ * \param version schema version of the options data structure
  * \param options pointer to options data structure
- * \param data options data structure size, must be less than 256 bytes
+ * \param optionsSize options data structure size, less than 248 bytes
+ * \return true if options of that type and version were found
  */
-void loadOptions(void *options, int optionsSize);
+bool loadOptions(int type, int version, void *options, int optionsSize);
 
 /**
  * Try to save options to FLASH. May fail in case of hardware errors.
+ * \param type record type
+ * \param version schema version of the options data structure
  * \param options pointer to options data structure
- * \param data options data structure size, must be less than 256 bytes
+ * \param optionsSize options data structure size, less than 248 bytes
+ * \return true on success, or if the options did not change
  */
-void saveOptions(void *options, int optionsSize);
+bool saveOptions(int type, int version, const void *options, int optionsSize);
@@ -0,0 +1,230 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <drivers/snapshot_store.h>
+#include <drivers/frame_recorder.h>
+#include <drivers/crc16.h>
+
+using namespace std;
+using namespace miosix;
+
+static_assert(snapshotEnd<=recorderStart, "Snapshots overlap the recorder");
+static_assert(sizeof(MLX90640RawFrame::subframe)==snapshotDataSize,
+              "Snapshot data size does not match the raw frame");
+
+//
+// class SnapshotStore
+//
+
+SnapshotStore::SnapshotStore() : flash(Flash::instance())
+{
+    SnapshotCatalogHeader header;
+    flash.read(snapshotStart,&header,sizeof(header));
+    if(header.magic!=snapshotMagic || header.slots!=snapshotSlots ||
+       header.dataSize!=snapshotDataSize ||
+       header.crc!=crc16Update(crc16Init,&header,offsetof(SnapshotCatalogHeader,crc)))
+    {
+        puts("Snapshot catalog not found, creating it");
+        Lock<FastMutex> l(flashMutex);
+        format();
+        return;
+    }
+    //Entries are written in order, so the unused ones are all at the end
+    int lo=0, hi=snapshotSlots;
+    while(lo<hi)
+    {
+        int mid=(lo+hi)/2;
+        if(unused(mid)) hi=mid; else lo=mid+1;
+    }
+    written=lo;
+    iprintf("%d snapshots\n",written);
+}
+
+void SnapshotStore::start()
+{
+    writerThread=Thread::create(SnapshotStore::writerThreadMainTramp,2048U,Priority(),static_cast<void*>(this),Thread::JOINABLE);
+}
+
+void SnapshotStore::stop()
+{
+    {
+        Lock<FastMutex> l(m);
+        quit=true;
+        cv.signal();
+    }
+    writerThread->join();
+}
+
+int SnapshotStore::capture(MLX90640RawFrame *frame, float emissivity)
+{
+    Lock<FastMutex> l(m);
+    int index=written+(writing ? 1 : 0);
+    if(pending!=nullptr || index>=snapshotSlots)
+    {
+        delete frame;
+        return -1;
+    }
+    pending=frame;
+    pendingEmissivity=emissivity;
+    cv.signal();
+    return index;
+}
+
+int SnapshotStore::count()
+{
+    Lock<FastMutex> l(m);
+    return written;
+}
+
+bool SnapshotStore::read(int index, MLX90640RawFrame *frame, Info& info)
+{
+    Lock<FastMutex> l(flashMutex);
+    if(index<0 || index>=count()) return false;
+    SnapshotEntry entry;
+    if(flash.read(snapshotEntryAddress(index),&entry,sizeof(entry))==false) return false;
+    if(entry.crc!=crc16Update(crc16Init,&entry,offsetof(SnapshotEntry,crc))) return false;
+    info.timestamp=entry.timestamp;
+    info.emissivity=entry.emissivity;
+    if(frame==nullptr) return true;
+    if(flash.read(snapshotDataAddress(index),frame->subframe,snapshotDataSize)==false)
+        return false;
+    frame->timestamp=entry.timestamp*1000000LL;
+    return entry.dataCrc==crc16Update(crc16Init,frame->subframe,snapshotDataSize);
+}
+
+void SnapshotStore::clear()
+{
+    Lock<FastMutex> l(flashMutex);
+    format();
+}
+
+void *SnapshotStore::writerThreadMainTramp(void *p)
+{
+    static_cast<SnapshotStore *>(p)->writerThreadMain();
+    return nullptr;
+}
+
+void SnapshotStore::writerThreadMain()
+{
+    Lock<FastMutex> l(m);
+    for(;;)
+    {
+        if(pending==nullptr)
+        {
+            if(quit) break;
+            cv.wait(l);
+            continue;
+        }
+        MLX90640RawFrame *frame=pending;
+        pending=nullptr;
+        writing=true;
+        {
+            Unlock<FastMutex> u(l);
+            {
+                Lock<FastMutex> fl(flashMutex);
+                write(frame,pendingEmissivity);
+            }
+            delete frame;
+        }
+        writing=false;
+    }
+    iprintf("snapshotWriterThread min free stack %d\n",
+            MemoryProfiling::getAbsoluteFreeStack());
+}
+
+bool SnapshotStore::write(const MLX90640RawFrame *frame, float emissivity)
+{
+    //Read again, clear() may have been called since the snapshot was queued
+    int index=count();
+    if(index>=snapshotSlots) return false;
+    unsigned int addr=snapshotDataAddress(index);
+    flash.eraseSector(addr);
+    if(program(addr,frame->subframe,snapshotDataSize)==false)
+    {
+        //Without its entry the slot is still free, and erased again next time
+        iprintf("Failed to write snapshot @ address 0x%x\n",addr);
+        return false;
+    }
+    SnapshotEntry entry;
+    entry.timestamp=frame->timestamp/1000000;
+    entry.emissivity=emissivity;
+    entry.dataCrc=crc16Update(crc16Init,frame->subframe,snapshotDataSize);
+    memset(entry.reserved,0xff,sizeof(entry.reserved));
+    entry.crc=crc16Update(crc16Init,&entry,offsetof(SnapshotEntry,crc));
+    bool success=program(snapshotEntryAddress(index),&entry,sizeof(entry));
+    if(success==false)
+    {
+        //The entry can't be programmed again, make sure it does not look
+        //unused, or the binary search would stop at it
+        iprintf("Failed to write snapshot entry %d\n",index);
+        const SnapshotEntry damaged={};
+        program(snapshotEntryAddress(index),&damaged,sizeof(damaged));
+    }
+    Lock<FastMutex> l(m);
+    written++;
+    return success;
+}
+
+void SnapshotStore::format()
+{
+    flash.eraseSector(snapshotStart);
+    SnapshotCatalogHeader header;
+    header.magic=snapshotMagic;
+    header.slots=snapshotSlots;
+    header.dataSize=snapshotDataSize;
+    memset(header.reserved,0xff,sizeof(header.reserved));
+    header.crc=crc16Update(crc16Init,&header,offsetof(SnapshotCatalogHeader,crc));
+    if(program(snapshotStart,&header,sizeof(header))==false)
+        puts("Failed to write snapshot catalog");
+    Lock<FastMutex> l(m);
+    written=0;
+}
+
+bool SnapshotStore::program(unsigned int addr, const void *data, int size)
+{
+    auto *p=static_cast<const uint8_t*>(data);
+    while(size>0)
+    {
+        int chunk=min<int>(size,flash.pageSize()-addr%flash.pageSize());
+        if(flash.write(addr,p,chunk)==false) return false;
+        addr+=chunk;
+        p+=chunk;
+        size-=chunk;
+    }
+    return true;
+}
+
+bool SnapshotStore::unused(int index)
+{
+    SnapshotEntry entry;
+    if(flash.read(snapshotEntryAddress(index),&entry,sizeof(entry))==false) return false;
+    auto *p=reinterpret_cast<const uint8_t*>(&entry);
+    return all_of(p,p+sizeof(entry),[](uint8_t b){ return b==0xff; });
+}
@@ -0,0 +1,222 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Snapshots, raw frames stored to FLASH on user request, so they can be
+ * processed again and viewed later. They are stored after the first 64KByte
+ * block, which is left for the options, up to snapshotEnd. All fields are
+ * little endian.
+ *
+ * The first sector is the catalog: a SnapshotCatalogHeader followed by one
+ * SnapshotEntry per snapshot, in capture order. Each following sector is the
+ * slot of one snapshot, so the catalog entry and the data of snapshot N are
+ * at fixed addresses, found without scanning the FLASH. The data is the two
+ * subframes of the MLX90640RawFrame, processed again with the emissivity in
+ * the entry.
+ *
+ * Snapshots are only appended: the slot is erased and programmed, and then
+ * the entry. An entry that is all 0xff ends the catalog, so the number of
+ * snapshots is found with a binary search. An entry whose CRC does not match,
+ * left by a power loss while writing it, is a damaged snapshot, as is one
+ * whose data CRC does not match. Snapshots are deleted all at once, by
+ * erasing the catalog.
+ */
+
+const uint32_t snapshotStart=64*1024;         ///< Address of the catalog
+const uint32_t snapshotEnd=1024*1024;         ///< First FLASH address not used
+const uint32_t snapshotSectorSize=4*1024;     ///< FLASH sector size
+const uint32_t snapshotMagic=0x50414e53;      ///< "SNAP"
+/// Number of snapshots that can be stored
+const int snapshotSlots=(snapshotEnd-snapshotStart)/snapshotSectorSize-1;
+/// Size of the data of a snapshot, the raw frame subframes
+const int snapshotDataSize=2*834*sizeof(uint16_t);
+
+/**
+ * At the start of the catalog sector
+ */
+struct SnapshotCatalogHeader
+{
+    uint32_t magic;       ///< snapshotMagic
+    uint16_t slots;       ///< snapshotSlots, the catalog is reset if changed
+    uint16_t dataSize;    ///< snapshotDataSize, the catalog is reset if changed
+    uint8_t reserved[6];  ///< 0xff
+    uint16_t crc;         ///< crc16Update() of the previous fields
+};
+
+/**
+ * One per snapshot, after the catalog header
+ */
+struct SnapshotEntry
+{
+    uint32_t timestamp;   ///< Capture time in milliseconds since boot
+    float emissivity;     ///< To process the raw frame with
+    uint16_t dataCrc;     ///< crc16Update() of the snapshot data
+    uint8_t reserved[4];  ///< 0xff
+    uint16_t crc;         ///< crc16Update() of the previous fields
+};
+
+static_assert(sizeof(SnapshotCatalogHeader)==16, "Unexpected padding");
+static_assert(sizeof(SnapshotEntry)==16, "Unexpected padding");
+static_assert(sizeof(SnapshotCatalogHeader)+snapshotSlots*sizeof(SnapshotEntry)
+              <=snapshotSectorSize, "The catalog must fit in a sector");
+static_assert(snapshotDataSize<=snapshotSectorSize, "A snapshot must fit in a slot");
+
+/**
+ * \param index snapshot index
+ * \return the address of the catalog entry of the snapshot
+ */
+inline uint32_t snapshotEntryAddress(int index)
+{
+    return snapshotStart+sizeof(SnapshotCatalogHeader)+index*sizeof(SnapshotEntry);
+}
+
+/**
+ * \param index snapshot index
+ * \return the address of the data of the snapshot
+ */
+inline uint32_t snapshotDataAddress(int index)
+{
+    return snapshotStart+(index+1)*snapshotSectorSize;
+}
+
+#ifdef _MIOSIX
+
+#include <miosix.h>
+#include <drivers/mlx90640frame.h>
+#include <drivers/flash.h>
+
+/**
+ * Stores snapshots to FLASH from a background thread, as erasing and
+ * programming a slot takes ~60ms. Only one snapshot can be waiting to be
+ * written, so capturing never blocks the caller
+ */
+class SnapshotStore
+{
+public:
+    /**
+     * Constructor, finds the number of snapshots from the catalog, and
+     * creates the catalog if the FLASH does not have a valid one
+     */
+    SnapshotStore();
+
+    /**
+     * Start the writer thread
+     */
+    void start();
+
+    /**
+     * Stop the writer thread, waiting for the pending snapshot to be written
+     */
+    void stop();
+
+    /**
+     * Queue a snapshot to be written, without blocking
+     * \param frame raw frame, ownership is transferred
+     * \param emissivity emissivity the frame was processed with
+     * \return the index the snapshot will have, or -1 if it was dropped as
+     * the previous one is still being written or the FLASH is full
+     */
+    int capture(MLX90640RawFrame *frame, float emissivity);
+
+    /**
+     * \return the number of snapshots written, including damaged ones
+     */
+    int count();
+
+    /**
+     * Snapshot metadata from the catalog
+     */
+    struct Info
+    {
+        uint32_t timestamp;  ///< Capture time in milliseconds since boot
+        float emissivity;    ///< To process the raw frame with
+    };
+
+    /**
+     * Read a snapshot
+     * \param index snapshot index, from 0 to count()-1
+     * \param frame the raw frame is stored here, its timestamp is the capture
+     * time. Can be nullptr to read only the metadata
+     * \param info the metadata is stored here
+     * \return false if the index is not valid or the snapshot is damaged
+     */
+    bool read(int index, MLX90640RawFrame *frame, Info& info);
+
+    /**
+     * Delete all snapshots, waiting for the one being written if any
+     */
+    void clear();
+
+private:
+    SnapshotStore(const SnapshotStore&)=delete;
+    SnapshotStore& operator=(const SnapshotStore&)=delete;
+
+    static void *writerThreadMainTramp(void *p);
+    void writerThreadMain();
+
+    /**
+     * Write a snapshot to the first free slot, then its catalog entry.
+     * Requires flashMutex to be locked
+     * \return false if the FLASH is full or on write errors
+     */
+    bool write(const MLX90640RawFrame *frame, float emissivity);
+
+    /**
+     * Erase the catalog and write its header.
+     * Requires flashMutex to be locked
+     */
+    void format();
+
+    /**
+     * Write data across page boundaries
+     */
+    bool program(unsigned int addr, const void *data, int size);
+
+    /**
+     * \return true if the catalog entry is all 0xff
+     */
+    bool unused(int index);
+
+    Flash& flash;
+    miosix::Thread *writerThread=nullptr;
+    miosix::FastMutex flashMutex; ///< Serializes writes, reads and clear
+
+    //Shared between threads, protected by m
+    miosix::FastMutex m;
+    miosix::ConditionVariable cv;
+    MLX90640RawFrame *pending=nullptr; ///< Snapshot waiting to be written
+    float pendingEmissivity;
+    bool writing=false;                ///< The writer is writing a snapshot
+    int written=0;                     ///< Catalog entries in use
+    bool quit=false;
+};
+
+#endif //_MIOSIX
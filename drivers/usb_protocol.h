@@ -0,0 +1,144 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include "crc16.h"
+
+/*
+ * Binary streaming protocol over USB, shared by the firmware and the host
+ * tools.
+ *
+ * The start_stream_binary command replies with the "binary" line, then the
+ * device sends packets until stop_stream. Each packet is made of a
+ * UsbPacketHeader, length bytes of payload and the crc16Update() of both
+ * header and payload, starting from crc16Init. All fields are little endian.
+ * Firmware that does not know the command replies "Unrecognized command", and
+ * the host can fall back to the hex format of start_stream.
+ *
+ * The start_stream_binary_compressed and start_stream_processed_compressed
+ * commands send the frames coded with FrameEncoder (frame_codec.h) instead,
+ * setting usbPacketCompressed in the packet flags. ProcessedFrame payloads
+ * keep the UsbFrameStats uncompressed, followed by the coded temperatures.
+ * Frames following a sequence gap can't be decoded until the next packet
+ * with usbPacketKeyframe set.
+ *
+ * Appending a number to the binary start commands, as in
+ * "start_stream_binary 8", enables credit based flow control with that many
+ * frames of initial credit. Each packet consumes one credit, and "credit <n>"
+ * grants n more frames. Without credit the device skips frames instead of
+ * blocking on USB writes, and reports their number in the next packet. A
+ * packet whose write times out is not sent, and its credit and sequence number
+ * are not used. Credit commands have no reply, so they can be sent while
+ * packets are received. As a credit command may be lost too, the host grants
+ * credit again if no packet arrives for a few seconds.
+ *
+ * "test_stream <n>" replies "binary", then sends n Test packets as fast as
+ * possible, to measure the USB throughput.
+ *
+ * "download [offset [size]]" replies "binary", then sends the FLASH contents
+ * from offset (0 by default) for size bytes (up to the end by default) in
+ * FlashData packets of at most usbDownloadChunkSize bytes, in address order.
+ * The numbers can be decimal or 0x prefixed hex, other arguments are rejected
+ * with "Unrecognized command". The last packet has no data after the address,
+ * which is where the download stopped: if it is before the requested end, a
+ * FLASH read or USB write failed, and the download can be resumed with a new
+ * command starting there. The packet CRC is what lets the host verify each
+ * chunk.
+ *
+ * Packets are normally sent on the CDC serial port, interleaved with command
+ * replies. After "stream_to_bulk", which replies "bulk", the binary stream and
+ * test commands send them on the bulk IN endpoint of a vendor interface
+ * instead, until stop_stream. Commands and their replies stay on the serial
+ * port. Firmware without the vendor interface replies "Unrecognized command".
+ */
+
+const uint16_t usbVendorId=0xcafe;      ///< USB vendor ID of the camera
+const uint16_t usbProductId=0x4002;     ///< USB product ID, CDC and vendor
+const uint8_t usbBulkInterface=2;       ///< Vendor interface for packets
+const uint8_t usbBulkInEndpoint=0x83;   ///< Bulk IN endpoint for packets
+
+const uint16_t usbPacketSync=0x5aa5; ///< Sent as 0xa5, 0x5a
+
+/**
+ * Packet payload type
+ */
+enum class UsbPacketType : uint8_t
+{
+    RawFrame=1,       ///< Both MLX90640RawFrame subframes, 2*834 16 bit words
+    ProcessedFrame=2, ///< UsbFrameStats followed by 32*24 temperatures
+    Test=3,           ///< Zeros, the size of a RawFrame, sent by test_stream
+    FlashData=4       ///< uint32_t FLASH address and the data read there
+};
+
+const uint8_t usbPacketCompressed=1<<0; ///< Payload coded with FrameEncoder
+const uint8_t usbPacketKeyframe=1<<1;   ///< Payload decodable on its own
+
+/**
+ * Header of binary packets
+ */
+struct __attribute__((packed)) UsbPacketHeader
+{
+    uint16_t sync;      ///< Always usbPacketSync
+    uint8_t type;       ///< UsbPacketType
+    uint8_t flags;      ///< Bitmask of usbPacketCompressed, usbPacketKeyframe
+    uint16_t length;    ///< Payload length in bytes
+    uint16_t skipped;   ///< Frames skipped by the device since the last packet
+    uint32_t sequence;  ///< Incremented for each packet, gaps are lost packets
+    uint64_t timestamp; ///< When the frame was read, in ns since boot
+};
+
+/**
+ * Statistics at the start of ProcessedFrame payloads, followed by the
+ * MLX90640Frame::temperature array as 16 bit signed values. Temperatures are
+ * in °C multiplied by scaleFactor, and pixel indices refer to that array
+ */
+struct __attribute__((packed)) UsbFrameStats
+{
+    int16_t minTemp;         ///< Minimum temperature
+    int16_t maxTemp;         ///< Maximum temperature
+    int16_t meanTemp;        ///< Mean temperature, rounded
+    int16_t crosshairTemp;   ///< Temperature of the center pixel
+    uint16_t argMin;         ///< Index of the pixel with the minimum temperature
+    uint16_t argMax;         ///< Index of the pixel with the maximum temperature
+    uint16_t scaleFactor;    ///< Temperature scale factor
+    uint16_t histogram[32];  ///< Same as MLX90640FrameStats::histogram
+};
+
+const int usbPacketCrcSize=2; ///< Bytes of CRC after the payload
+const int usbMaxPayloadSize=2*834*3; ///< Largest payload, a compressed RawFrame
+const int usbTxBufferSize=4096; ///< Size of the device CDC and vendor TX FIFOs
+/// Largest FlashData data size, so that a whole FlashData packet fits in the
+/// TX FIFO, and a write that times out never sends a truncated packet
+const int usbDownloadChunkSize=usbTxBufferSize-sizeof(UsbPacketHeader)
+                              -sizeof(uint32_t)-usbPacketCrcSize;
+
+static_assert(sizeof(UsbPacketHeader)+sizeof(uint32_t)+usbDownloadChunkSize
+              +usbPacketCrcSize<=usbTxBufferSize, "FlashData packets too large");
+static_assert(sizeof(uint32_t)+usbDownloadChunkSize<=usbMaxPayloadSize,
+              "FlashData packets too large");
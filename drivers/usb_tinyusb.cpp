@@ -26,6 +26,7 @@
  ***************************************************************************/
 
 #include "usb_tinyusb.h"
+#include "usb_protocol.h"
 #include "tusb.h"
 #include "hwmapping.h"
 #include "interfaces/arch_registers.h"
@@ -35,6 +36,9 @@ using namespace miosix;
 FastMutex txMutex;
 ConditionVariable txComplete;
 
+FastMutex bulkTxMutex;
+ConditionVariable bulkTxComplete;
+
 FastMutex rxMutex;
 ConditionVariable rxAvail;
 
@@ -130,29 +134,93 @@ void USBCDC::write(const uint8_t *buf, int size)
 
 bool USBCDC::write(const uint8_t *buf, int size, long long maxTime)
 {
-    Lock<FastMutex> lock(txMutex);
+    USBSegment segment = { buf, size };
+    return write(&segment, 1, maxTime);
+}
+
+/**
+ * TinyUSB functions to write to the FIFO of an IN endpoint, so that the CDC
+ * and vendor interfaces share the same write path
+ */
+struct TxInterface
+{
+    uint32_t (*available)(uint8_t itf);
+    uint32_t (*write)(uint8_t itf, void const *buffer, uint32_t size);
+    uint32_t (*flush)(uint8_t itf);
+    unsigned int fifoSize;
+};
+
+static const TxInterface cdcTx = {
+    tud_cdc_n_write_available, tud_cdc_n_write, tud_cdc_n_write_flush,
+    CFG_TUD_CDC_TX_BUFSIZE
+};
+
+static const TxInterface vendorTx = {
+    tud_vendor_n_write_available, tud_vendor_n_write, tud_vendor_n_write_flush,
+    CFG_TUD_VENDOR_TX_BUFSIZE
+};
+
+static_assert(CFG_TUD_CDC_TX_BUFSIZE>=usbTxBufferSize &&
+              CFG_TUD_VENDOR_TX_BUFSIZE>=usbTxBufferSize,
+              "TX FIFOs smaller than usbTxBufferSize");
+
+bool USBCDC::writeSegments(const TxInterface& itf, Lock<FastMutex>& lock,
+        ConditionVariable& cv, const USBSegment *segments, int count, long long maxTime)
+{
     if (forceEOF)
         return false;
     long long timeout = getTime() + maxTime;
 
-    int sent = tud_cdc_n_write(0, buf, size);
-    size -= sent;
-    buf += sent;
-    while (size > 0) {
-        if (txComplete.timedWait(lock, timeout) == TimedWaitResult::Timeout || forceEOF)
-            return false;
-        sent = tud_cdc_n_write(0, buf, size);
+    // If the data fits in the FIFO, wait until there is room for all of it,
+    // so that a timeout never sends a truncated packet
+    unsigned int total = 0;
+    for (int i = 0; i < count; i++) total += segments[i].size;
+    if (total <= itf.fifoSize) {
+        while (itf.available(0) < total) {
+            if (cv.timedWait(lock, timeout) == TimedWaitResult::Timeout || forceEOF)
+                return false;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        auto *buf = reinterpret_cast<const uint8_t *>(segments[i].buf);
+        int size = segments[i].size;
+        int sent = itf.write(0, buf, size);
         size -= sent;
         buf += sent;
+        while (size > 0) {
+            if (cv.timedWait(lock, timeout) == TimedWaitResult::Timeout || forceEOF)
+                return false;
+            sent = itf.write(0, buf, size);
+            size -= sent;
+            buf += sent;
+        }
     }
 
-    if (tud_cdc_n_write_flush(0) > 0) {
-        if (txComplete.timedWait(lock, timeout) == TimedWaitResult::Timeout || forceEOF)
-            return false;
-    }
+    // Start sending what is left in the FIFO, if the endpoint is idle. There
+    // is no need to wait for the transfer, as TinyUSB keeps sending from the
+    // FIFO when each transfer completes
+    itf.flush(0);
     return true;
 }
 
+bool USBCDC::write(const USBSegment *segments, int count, long long maxTime)
+{
+    Lock<FastMutex> lock(txMutex);
+    return writeSegments(cdcTx, lock, txComplete, segments, count, maxTime);
+}
+
+bool USBCDC::bulkConnected()
+{
+    return tud_vendor_n_mounted(0);
+}
+
+bool USBCDC::writeBulk(const USBSegment *segments, int count, long long maxTime)
+{
+    Lock<FastMutex> lock(bulkTxMutex);
+    return writeSegments(vendorTx, lock, bulkTxComplete, segments, count, maxTime);
+}
+
 void USBCDC::print(const char *str)
 {
     int len = strlen(str);
@@ -227,6 +295,10 @@ void USBCDC::prepareShutdown()
         Lock<FastMutex> lock(txMutex);
         txComplete.signal();
     }
+    {
+        Lock<FastMutex> lock(bulkTxMutex);
+        bulkTxComplete.signal();
+    }
     tinyusbThread->terminate();
 }
 
@@ -260,6 +332,12 @@ extern "C" void tud_cdc_tx_complete_cb(uint8_t itf)
     txComplete.signal();
 }
 
+extern "C" void tud_vendor_tx_cb(uint8_t itf, uint32_t sent_bytes)
+{
+    Lock<FastMutex> lock(bulkTxMutex);
+    bulkTxComplete.signal();
+}
+
 extern "C" void tud_cdc_rx_cb(uint8_t itf)
 {
     Lock<FastMutex> lock(rxMutex);
@@ -271,17 +349,18 @@ enum USBStringDescID {
     None = 0,
     Manufacturer,
     Product,
-    Serial
+    Serial,
+    Frames
 };
 
 // Called when the device descriptor is requested from the host.
 uint8_t const *tud_descriptor_device_cb(void)
 {
-    static const uint16_t vid = 0xcafe;
+    static const uint16_t vid = usbVendorId;
     // Some OSes (Windows...) remember device configuration based on vid/pid,
     // so if the set of supported interfaces changes, the pid should also
     // change.
-    static const uint16_t pid = 0x4001;
+    static const uint16_t pid = usbProductId;
     static const uint16_t version = 0x0100;
     static const tusb_desc_device_t desc_device = {
         .bLength = sizeof(tusb_desc_device_t),
@@ -320,14 +399,19 @@ uint8_t const *tud_descriptor_configuration_cb(uint8_t index)
     enum USBInterfaceID {
         CDC = 0,
         CDCData, // Implicitly added by the TUD_CDC_DESCRIPTOR macro
+        Vendor,
         Total
     };
     enum USBEndpointID {
         CDCOut = 0x02,
         CDCNotif = 0x81,
-        CDCIn = 0x82
+        CDCIn = 0x82,
+        VendorOut = 0x03,
+        VendorIn = 0x83
     };
-    static const size_t length = TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN;
+    static_assert(USBInterfaceID::Vendor == usbBulkInterface, "Wrong interface");
+    static_assert(USBEndpointID::VendorIn == usbBulkInEndpoint, "Wrong endpoint");
+    static const size_t length = TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_VENDOR_DESC_LEN;
     static uint8_t const desc_fs_configuration[length] = {
         // Configuration descriptor
         TUD_CONFIG_DESCRIPTOR(
@@ -346,7 +430,15 @@ uint8_t const *tud_descriptor_configuration_cb(uint8_t index)
             8,                          // notification endpoint size
             USBEndpointID::CDCOut,      // data out endpoint address
             USBEndpointID::CDCIn,       // data in endpoint address
-            64                          // data endpoint size
+            64                          // data endpoint size, full speed max
+        ),
+        // Frame stream interface, only the IN endpoint is used
+        TUD_VENDOR_DESCRIPTOR(
+            USBInterfaceID::Vendor,     // Interface number
+            USBStringDescID::Frames,    // string index
+            USBEndpointID::VendorOut,   // data out endpoint address
+            USBEndpointID::VendorIn,    // data in endpoint address
+            64                          // data endpoint size, full speed max
         ),
     };
     return desc_fs_configuration;
@@ -389,6 +481,7 @@ uint16_t const *tud_descriptor_string_cb(uint8_t index, uint16_t langid)
 
         if(index == USBStringDescID::Manufacturer) str = "TinyUSB";
         else if(index == USBStringDescID::Product) str = "Thermal Camera";
+        else if(index == USBStringDescID::Frames) str = "Thermal Camera Frames";
         else if(index == USBStringDescID::Serial) { // Serial
             for(int i=0; i<7; i++) chipid_buf[i] = STM32_DEVICE_ID->lot[i];
             siprintf(chipid_buf+7, "%02X%04X%04X",
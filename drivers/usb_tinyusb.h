@@ -29,6 +29,17 @@
 
 #include "miosix.h"
 
+/**
+ * One of the buffers of a gather write
+ */
+struct USBSegment
+{
+    const void *buf;
+    int size;
+};
+
+struct TxInterface;
+
 class USBCDC
 {
 public:
@@ -40,6 +51,15 @@ public:
     void putChar(char c);
     void write(const uint8_t *buf, int size);
     bool write(const uint8_t *buf, int size, long long maxWait);
+    // Writes the segments one after the other straight into the TinyUSB FIFO
+    // with a single flush at the end. The buffers can be reused on return.
+    // If they fit in the FIFO, they are written entirely or not at all
+    bool write(const USBSegment *segments, int count, long long maxWait);
+
+    // The vendor bulk interface used to stream frames, see usb_protocol.h
+    bool bulkConnected();
+    bool writeBulk(const USBSegment *segments, int count, long long maxWait);
+
     void print(const char *str);
     bool print(const char *str, long long maxWait);
 
@@ -56,6 +76,8 @@ private:
 
     bool waitForInputUnlocked(miosix::Lock<miosix::FastMutex>& lock, long long deadline);
     int getCharUnlocked(miosix::Lock<miosix::FastMutex>& lock);
+    bool writeSegments(const TxInterface& itf, miosix::Lock<miosix::FastMutex>& lock,
+        miosix::ConditionVariable& cv, const USBSegment *segments, int count, long long maxWait);
 
     miosix::Thread *tinyusbThread;
     volatile bool forceEOF = false;
@@ -96,6 +96,11 @@ public:
         return state!=oldState && state==LongPress;
     }
 
+    bool getShortPressEvent()
+    {
+        return getUpEvent() && oldState==Down;
+    }
+
     bool getAutorepeatEvent()
     {
         return getDownEvent() || autorepeatTrig;
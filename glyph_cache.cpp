@@ -0,0 +1,168 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "glyph_cache.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+using namespace mxgui;
+
+/**
+ * Minimal drawing surface backed by a memory buffer, with just the interface
+ * the mxgui font engine needs to render text into it
+ */
+class MemorySurface
+{
+public:
+    MemorySurface(Color *buffer, short width, short height)
+        : buffer(buffer), width(width), height(height) {}
+
+    class pixel_iterator
+    {
+    public:
+        pixel_iterator() : buffer(nullptr), stride(0), x0(0), x1(0), y0(0),
+            y1(0), x(0), y(0), d(RD) {}
+
+        pixel_iterator& operator= (Color color)
+        {
+            buffer[x+y*stride]=color;
+            if(d==DR)
+            {
+                if(++y>y1) { y=y0; x++; }
+            } else {
+                if(++x>x1) { x=x0; y++; }
+            }
+            return *this;
+        }
+
+        bool operator== (const pixel_iterator& itr)
+        {
+            return x==itr.x && y==itr.y;
+        }
+
+        bool operator!= (const pixel_iterator& itr)
+        {
+            return x!=itr.x || y!=itr.y;
+        }
+
+        pixel_iterator& operator* () { return *this; }
+
+        pixel_iterator& operator++ () { return *this; }
+
+        pixel_iterator& operator++ (int) { return *this; }
+
+        void invalidate() {}
+
+    private:
+        pixel_iterator(Color *buffer, short stride, Point p1, Point p2,
+                IteratorDirection d) : buffer(buffer), stride(stride),
+                x0(p1.x()), x1(p2.x()), y0(p1.y()), y1(p2.y()),
+                x(p1.x()), y(p1.y()), d(d) {}
+
+        Color *buffer;
+        short stride, x0, x1, y0, y1, x, y;
+        IteratorDirection d;
+
+        friend class MemorySurface;
+    };
+
+    /**
+     * The window must lie within the surface, which is always the case when
+     * rendering the glyphs
+     */
+    pixel_iterator begin(Point p1, Point p2, IteratorDirection d)
+    {
+        //One past the last pixel, where the iterator is after the last write
+        last=pixel_iterator(buffer,width,p1,p2,d);
+        if(d==DR) last.x=p2.x()+1;
+        else last.y=p2.y()+1;
+        return pixel_iterator(buffer,width,p1,p2,d);
+    }
+
+    pixel_iterator end() const { return last; }
+
+    short getWidth() const { return width; }
+
+    short getHeight() const { return height; }
+
+private:
+    Color *buffer;
+    short width, height;
+    pixel_iterator last;
+};
+
+//
+// class GlyphCache
+//
+
+GlyphCache::GlyphCache(const Font& font, Color fg, Color bg)
+    : stripWidth(0), height(font.getHeight()), bg(bg)
+{
+    static const char glyphs[numGlyphs+1]="0123456789-";
+    char s[2]={0,0};
+    for(int i=0;i<numGlyphs;i++)
+    {
+        s[0]=glyphs[i];
+        offset[i]=stripWidth;
+        width[i]=font.calculateLength(s);
+        stripWidth+=width[i];
+    }
+    strip=make_unique<Color[]>(stripWidth*height);
+    MemorySurface surface(strip.get(),stripWidth,height);
+    Color colors[4];
+    Font::generatePalette(colors,fg,bg);
+    for(int i=0;i<numGlyphs;i++)
+    {
+        s[0]=glyphs[i];
+        font.draw(surface,colors,Point(offset[i],0),s);
+    }
+}
+
+void GlyphCache::draw(DrawingContext& dc, Point a, Point b, int value)
+{
+    const short w=b.x()-a.x()+1;
+    const short h=min<short>(b.y()-a.y()+1,height);
+    if(w<=0 || h<=0 || w*h>maxFieldSize) return;
+    //Digits are composed right to left, starting from the least significant
+    unsigned int u=value<0 ? -value : value;
+    bool minus=value<0;
+    short x=w;
+    do {
+        int g;
+        if(u==0 && minus) { g=numGlyphs-1; minus=false; }
+        else { g=u%10; u/=10; }
+        short gw=min(width[g],x);
+        x-=gw;
+        for(short y=0;y<h;y++)
+            memcpy(field+x+y*w,strip.get()+offset[g]+width[g]-gw+y*stripWidth,
+                   gw*sizeof(Color));
+        if(u==0 && minus==false) break;
+    } while(x>0);
+    for(short y=0;y<h;y++) fill(field+y*w,field+y*w+x,bg);
+    dc.drawImage(a,Image(h,w,field));
+}
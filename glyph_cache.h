@@ -0,0 +1,75 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include <mxgui/display.h>
+#include <memory>
+
+/**
+ * Pre-rendered digits used to draw numeric readouts (the temperatures) that
+ * change every frame. Glyphs are rendered once through the mxgui font engine
+ * into an RGB565 strip, then each number is composed in RAM and sent to the
+ * display as a single image, avoiding the per-character font rendering and
+ * the many small display windows it opens
+ */
+class GlyphCache
+{
+public:
+    /**
+     * Constructor, renders the glyphs
+     * \param font font to use
+     * \param fg text color
+     * \param bg background color, also used for padding
+     */
+    GlyphCache(const mxgui::Font& font, mxgui::Color fg, mxgui::Color bg);
+
+    /**
+     * Draw a number right-aligned in a field, padding the rest of the field
+     * with the background color. Digits that do not fit are clipped on the left
+     * \param dc drawing context
+     * \param a upper left corner of the field
+     * \param b lower right corner of the field (included)
+     * \param value number to draw
+     */
+    void draw(mxgui::DrawingContext& dc, mxgui::Point a, mxgui::Point b, int value);
+
+private:
+    GlyphCache(const GlyphCache&)=delete;
+    GlyphCache& operator=(const GlyphCache&)=delete;
+
+    static const int numGlyphs=11;  ///< Digits 0 to 9, then minus sign
+    static const int maxFieldSize=36*16; ///< Largest field in pixels
+
+    short offset[numGlyphs]; ///< Glyph start column in the strip
+    short width[numGlyphs];  ///< Glyph width in pixels
+    short stripWidth;
+    short height;
+    mxgui::Color bg;
+    std::unique_ptr<mxgui::Color[]> strip; ///< All glyphs, side by side
+    mxgui::Color field[maxFieldSize];      ///< Composed field being drawn
+};
@@ -0,0 +1,109 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+/**
+ * How the color range of the displayed image follows the scene
+ */
+enum class RangeMode
+{
+    Auto,   ///< Range is the minimum and maximum of each frame
+    Smooth, ///< Range follows the scene with attack/decay and hysteresis
+    Locked  ///< Range is frozen to its value when it was locked
+};
+
+/**
+ * Tracks the temperature range used to map a frame into colors, filtering
+ * frame to frame noise so that the colormap doesn't flicker.
+ * Temperatures are in the same scaled units as MLX90640Frame::temperature,
+ * the filter state is in fixed point with 8 fractional bits.
+ */
+class RangeTracker
+{
+public:
+    /**
+     * Constructor
+     * \param attack fraction of the difference, in 1/256 units, applied per
+     * frame when the scene gets outside the current range
+     * \param decay fraction of the difference, in 1/256 units, applied per
+     * frame when the scene gets back inside the current range
+     * \param hysteresis differences up to this value between the current range
+     * and the scene are ignored
+     */
+    RangeTracker(int attack, int decay, short hysteresis)
+        : attack(attack), decay(decay), hysteresis(hysteresis) {}
+
+    /**
+     * \param mode new range mode. Changing from Locked to Smooth makes the
+     * range start following the scene again from the locked value
+     */
+    void setMode(RangeMode mode) { this->mode=mode; }
+
+    /**
+     * Update the range with a new frame
+     * \param frameMin minimum temperature of the frame
+     * \param frameMax maximum temperature of the frame
+     */
+    void update(short frameMin, short frameMax)
+    {
+        if(valid==false || mode==RangeMode::Auto)
+        {
+            lo=frameMin*256;
+            hi=frameMax*256;
+            valid=true;
+            return;
+        }
+        if(mode==RangeMode::Locked) return;
+        lo=filter(lo,frameMin,frameMin<low());
+        hi=filter(hi,frameMax,frameMax>high());
+    }
+
+    /**
+     * \return the lower end of the range
+     */
+    short low() const { return (lo+128)>>8; }
+
+    /**
+     * \return the upper end of the range
+     */
+    short high() const { return (hi+128)>>8; }
+
+private:
+    int filter(int state, short target, bool expanding) const
+    {
+        int delta=target*256-state;
+        if(delta>-hysteresis*256 && delta<hysteresis*256) return state;
+        return state+delta*(expanding ? attack : decay)/256;
+    }
+
+    const int attack, decay;
+    const short hysteresis;
+    RangeMode mode=RangeMode::Auto;
+    bool valid=false;
+    int lo, hi; ///< Range ends, fixed point with 8 fractional bits
+};
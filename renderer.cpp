@@ -26,7 +26,6 @@
  ***************************************************************************/
 
 #include <renderer.h>
-#include <colormap.h>
 #include <mxgui/misc_inst.h>
 
 using namespace std;
@@ -48,10 +47,27 @@ void ThermalImageRenderer::drawSmall(DrawingContext& dc, Point p)
     dc.drawImage(p,img);
 }
 
+void ThermalImageRenderer::setZoom(int zoom, int panX, int panY)
+{
+    if(zoom>=8) zoomShift=4;
+    else if(zoom>=4) zoomShift=3;
+    else if(zoom>=2) zoomShift=2;
+    else zoomShift=1;
+    this->panX=panX;
+    this->panY=panY;
+}
+
 void ThermalImageRenderer::legend(mxgui::Color *legend, int legendSize)
 {
-    int colormapRange=max(0,min<int>(maxTemp-minTemp,minRange))*255/minRange;
-    for(int i=0;i<legendSize;i++) legend[i]=colormap[colormapRange*i/(legendSize-1)];
+    const int scaledMinRange=minRange*MLX90640Frame::scaleFactor;
+    int colormapRange=max(0,min<int>(rangeHigh-rangeLow,scaledMinRange))*255/scaledMinRange;
+    int range=max<int>(scaledMinRange,rangeHigh-rangeLow);
+    for(int i=0;i<legendSize;i++)
+    {
+        int index=colormapRange*i/(legendSize-1);
+        short t=rangeLow+index*range/255; //Temperature mapped to that entry
+        legend[i]=pastIsotherm(t) ? isothermColor : palette[index];
+    }
 }
 
 template<void (ThermalImageRenderer::*putPix)(int x, int y, Color c)>
@@ -63,51 +79,100 @@ void ThermalImageRenderer::renderLoop(MLX90640Frame *processedFrame, short range
     {
         for(int x=0;x<nx-1;x++)
         {
-            c=interpolate2d(processedFrame,2*x,2*y,minTemp,range);
+            c=interpolate2d(processedFrame,2*x,2*y,rangeLow,range);
             (this->*putPix)(2*y, 2*x, c);
-            c=interpolate2d(processedFrame,2*x+1,2*y,minTemp,range);
+            c=interpolate2d(processedFrame,2*x+1,2*y,rangeLow,range);
             (this->*putPix)(2*y, 2*x+1, c);
         }
-        c=interpolate2d(processedFrame,62,2*y,minTemp,range);
+        c=interpolate2d(processedFrame,62,2*y,rangeLow,range);
         (this->*putPix)(2*y, 62, c);
         for(int x=0;x<nx-1;x++)
         {
-            c=interpolate2d(processedFrame,2*x,2*y+1,minTemp,range);
+            c=interpolate2d(processedFrame,2*x,2*y+1,rangeLow,range);
             (this->*putPix)(2*y+1, 2*x, c);
-            c=interpolate2d(processedFrame,2*x+1,2*y+1,minTemp,range);
+            c=interpolate2d(processedFrame,2*x+1,2*y+1,rangeLow,range);
             (this->*putPix)(2*y+1, 2*x+1, c);
         }
-        c=interpolate2d(processedFrame,62,2*y+1,minTemp,range);
+        c=interpolate2d(processedFrame,62,2*y+1,rangeLow,range);
         (this->*putPix)(2*y+1, 62, c);
     }
     for(int x=0;x<nx-1;x++)
     {
-        c=interpolate2d(processedFrame,2*x,46,minTemp,range);
+        c=interpolate2d(processedFrame,2*x,46,rangeLow,range);
         (this->*putPix)(46, 2*x, c);
-        c=interpolate2d(processedFrame,2*x+1,46,minTemp,range);
+        c=interpolate2d(processedFrame,2*x+1,46,rangeLow,range);
         (this->*putPix)(46, 2*x+1, c);
     }
-    c=interpolate2d(processedFrame,62,46,minTemp,range);
+    c=interpolate2d(processedFrame,62,46,rangeLow,range);
     (this->*putPix)(46, 62, c);
 }
 
-void ThermalImageRenderer::doRender(MLX90640Frame *processedFrame, bool small)
+template<void (ThermalImageRenderer::*putPix)(int x, int y, Color c)>
+void ThermalImageRenderer::renderZoomLoop(MLX90640Frame *processedFrame, short range)
+{
+    for(int y=0;y<47;y++)
+    {
+        for(int x=0;x<63;x++)
+        {
+            short t=interpolateZoom(processedFrame,originX+x,originY+y);
+            (this->*putPix)(y, x, pixMap(t,rangeLow,range));
+        }
+    }
+}
+
+void ThermalImageRenderer::computeWindow()
 {
+    //The rendered image is always 63x47 interpolated pixels, center is 31,23
     const int nx=MLX90640Frame::nx, ny=MLX90640Frame::ny;
-    minTemp=processedFrame->temperature[0];
-    maxTemp=processedFrame->temperature[0];
-    crosshairTemp=processedFrame->getTempAt(nx/2,ny/2);
-    for(int i=0;i<nx*ny;i++)
+    originX=max(0,min(((nx-1)<<zoomShift)-62,(panX<<zoomShift)-31));
+    originY=max(0,min(((ny-1)<<zoomShift)-46,(panY<<zoomShift)-23));
+    winX0=originX>>zoomShift;
+    winY0=originY>>zoomShift;
+    winX1=min(nx-1,((originX+62)>>zoomShift)+1);
+    winY1=min(ny-1,((originY+46)>>zoomShift)+1);
+}
+
+void ThermalImageRenderer::doRender(MLX90640Frame *processedFrame, bool small)
+{
+    computeWindow();
+    short frameMin, frameMax;
+    if(zoomShift==1)
     {
-        minTemp=min(minTemp,processedFrame->temperature[i]);
-        maxTemp=max(maxTemp,processedFrame->temperature[i]);
+        //Whole image visible, use the statistics computed during processing
+        frameMin=processedFrame->stats.minTemp;
+        frameMax=processedFrame->stats.maxTemp;
+        crosshairTemp=processedFrame->stats.crosshairTemp;
+    } else {
+        frameMin=processedFrame->getTempAt(winX0,winY0);
+        frameMax=frameMin;
+        for(int y=winY0;y<=winY1;y++)
+        {
+            for(int x=winX0;x<=winX1;x++)
+            {
+                frameMin=min(frameMin,processedFrame->getTempAt(x,y));
+                frameMax=max(frameMax,processedFrame->getTempAt(x,y));
+            }
+        }
+        crosshairTemp=interpolateZoom(processedFrame,originX+31,originY+23);
     }
-    short range=max<short>(minRange*processedFrame->scaleFactor,maxTemp-minTemp);
+    //The range tracker only drives the colormap, the readouts show the scene
+    rangeTracker.update(frameMin,frameMax);
+    rangeLow=rangeTracker.low();
+    rangeHigh=rangeTracker.high();
+    short range=max<short>(minRange*processedFrame->scaleFactor,rangeHigh-rangeLow);
+    if(equalize) equalizeHistogram(processedFrame,range);
+    else palette=colormap;
+    //The alarm uses the same test as the highlighted pixels
+    isothermLevel=isothermThreshold*processedFrame->scaleFactor;
+    alarmFlag=pastIsotherm(isothermMode==IsothermMode::Below ?
+        processedFrame->stats.minTemp : processedFrame->stats.maxTemp);
     if(small)
     {
-        renderLoop<&ThermalImageRenderer::putPixelSmall>(processedFrame, range);
+        if(zoomShift==1) renderLoop<&ThermalImageRenderer::putPixelSmall>(processedFrame, range);
+        else renderZoomLoop<&ThermalImageRenderer::putPixelSmall>(processedFrame, range);
     } else {
-        renderLoop<&ThermalImageRenderer::putPixelLarge>(processedFrame, range);
+        if(zoomShift==1) renderLoop<&ThermalImageRenderer::putPixelLarge>(processedFrame, range);
+        else renderZoomLoop<&ThermalImageRenderer::putPixelLarge>(processedFrame, range);
         //Draw crosshair
         static const unsigned char xrange[]={58,59,60,65,66,67};
         for(unsigned int xdex=0;xdex<sizeof(xrange);xdex++)
@@ -117,13 +182,35 @@ void ThermalImageRenderer::doRender(MLX90640Frame *processedFrame, bool small)
         for(int x=62;x<=63;x++)
             for(unsigned int ydex=0;ydex<sizeof(yrange);ydex++)
                 crosshairPixel(x,yrange[ydex]);
+        if(spotMarkers)
+        {
+            drawSpotMarker(processedFrame->stats.argMax,true);
+            drawSpotMarker(processedFrame->stats.argMin,false);
+        }
     }
     //Scale temperatures to express them in °C
-    minTemp=roundedDiv(minTemp,processedFrame->scaleFactor);
-    maxTemp=roundedDiv(maxTemp,processedFrame->scaleFactor);
+    minTemp=roundedDiv(frameMin,processedFrame->scaleFactor);
+    maxTemp=roundedDiv(frameMax,processedFrame->scaleFactor);
     crosshairTemp=roundedDiv(crosshairTemp,processedFrame->scaleFactor);
 }
 
+short ThermalImageRenderer::interpolateZoom(MLX90640Frame *processedFrame, int x, int y)
+{
+    //Generalization of interpolate2d, x and y are in units of 1/(1<<zoomShift)
+    //sensor pixels, bilinear interpolation weights are integers
+    const int nx=MLX90640Frame::nx, ny=MLX90640Frame::ny;
+    const int one=1<<zoomShift;
+    int x0=x>>zoomShift, y0=y>>zoomShift;
+    int x1=min(x0+1,nx-1), y1=min(y0+1,ny-1);
+    int fx=x & (one-1), fy=y & (one-1);
+    int t=(one-fx)*(one-fy)*processedFrame->getTempAt(x0,y0)
+         +fx      *(one-fy)*processedFrame->getTempAt(x1,y0)
+         +(one-fx)*fy      *processedFrame->getTempAt(x0,y1)
+         +fx      *fy      *processedFrame->getTempAt(x1,y1);
+    //Rounded division by one*one, shift rounds towards -inf also for t<0
+    return (t+(1<<(2*zoomShift-1)))>>(2*zoomShift);
+}
+
 Color ThermalImageRenderer::interpolate2d(MLX90640Frame *processedFrame, int x, int y, short m, short r)
 {
     if((x % 2)==0 && (y % 2)==0)
@@ -147,10 +234,58 @@ Color ThermalImageRenderer::interpolate2d(MLX90640Frame *processedFrame, int x,
     return pixMap(roundedDiv(t,4),m,r);
 }
 
-Color ThermalImageRenderer::pixMap(short t, short m, short r)
+void ThermalImageRenderer::equalizeHistogram(MLX90640Frame *processedFrame, short range)
 {
-    int pixel=(255*(t-m))/r;
-    return colormap[max(0,min(255,pixel))];
+    //The histogram is computed on the colormap indices of the linear mapping,
+    //so it costs one pass over the sensor pixels, and interpolated pixels
+    //still go through a single table lookup
+    unsigned short histogram[256]={0};
+    for(int y=winY0;y<=winY1;y++)
+        for(int x=winX0;x<=winX1;x++)
+            histogram[colormapIndex(processedFrame->getTempAt(x,y),rangeLow,range)]++;
+    //The coldest pixel always maps to colormap[0]. The hottest one maps to the
+    //same index as in the linear mapping, so that minRange is still honored
+    //and sensor noise isn't stretched over the whole colormap
+    int top=colormapIndex(rangeHigh,rangeLow,range);
+    int count=(winX1-winX0+1)*(winY1-winY0+1)-histogram[0];
+    int cumulative=0;
+    for(int i=0;i<256;i++)
+    {
+        if(i>0) cumulative+=histogram[i];
+        int index=count>0 ? cumulative*top/count : 0;
+        equalizedColormap[i]=colormap[index];
+    }
+    palette=equalizedColormap;
+}
+
+void ThermalImageRenderer::drawSpotMarker(int index, bool hot)
+{
+    //Center of the marker in irImage coordinates, if visible
+    int x=2*((MLX90640Frame::xOf(index)<<zoomShift)-originX);
+    int y=2*((MLX90640Frame::yOf(index)<<zoomShift)-originY);
+    if(x<0 || x>=126 || y<0 || y>=94) return;
+    for(int d=-3;d<=3;d++)
+    {
+        if(hot)
+        {
+            //Square
+            if(x+d>=0 && x+d<126)
+            {
+                if(y-3>=0) crosshairPixel(x+d,y-3);
+                if(y+3<94) crosshairPixel(x+d,y+3);
+            }
+            if(y+d>=0 && y+d<94 && d!=-3 && d!=3)
+            {
+                if(x-3>=0)  crosshairPixel(x-3,y+d);
+                if(x+3<126) crosshairPixel(x+3,y+d);
+            }
+        } else {
+            //Diagonal cross
+            if(x+d<0 || x+d>=126) continue;
+            if(y+d>=0 && y+d<94) crosshairPixel(x+d,y+d);
+            if(y-d>=0 && y-d<94 && d!=0) crosshairPixel(x+d,y-d);
+        }
+    }
 }
 
 void ThermalImageRenderer::crosshairPixel(int x, int y)
@@ -29,6 +29,18 @@
 
 #include <mxgui/display.h>
 #include "drivers/mlx90640frame.h"
+#include "range_tracker.h"
+#include "colormap.h"
+
+/**
+ * Isotherm highlighting mode
+ */
+enum class IsothermMode : unsigned char
+{
+    Off,   ///< No highlighting
+    Above, ///< Highlight pixels above the threshold
+    Below  ///< Highlight pixels below the threshold
+};
 
 /**
  * This class contains code to convert an array of temperatures into a
@@ -53,6 +65,58 @@ public:
      */
     void renderSmall(MLX90640Frame *processedFrame) { doRender(processedFrame,true); }
 
+    /**
+     * Select how temperatures are mapped to colors
+     * \param equalize if false, temperatures are linearly mapped to colors
+     * between the minimum and maximum of each frame. If true, the mapping is
+     * histogram-equalized, so that a few hot or cold spots do not crush the
+     * detail in the rest of the scene
+     */
+    void setHistogramEqualization(bool equalize) { this->equalize=equalize; }
+
+    /**
+     * Select the colormap used to render frames
+     * \param c colormap
+     */
+    void setColormap(Colormap c) { colormap=colormapData(c); }
+
+    /**
+     * Set digital zoom. When zoomed in, only the visible part of the sensor
+     * image is interpolated, and the color range and statistics are computed
+     * on the visible part only
+     * \param zoom zoom factor, 1 (whole image), 2, 4 or 8
+     * \param panX x coordinate of the sensor pixel at the center of the
+     * visible part of the image, 0 to MLX90640Frame::nx-1
+     * \param panY y coordinate of the sensor pixel at the center of the
+     * visible part of the image, 0 to MLX90640Frame::ny-1
+     */
+    void setZoom(int zoom, int panX, int panY);
+
+    /**
+     * Configure isotherm highlighting and the temperature alarm.
+     * Highlighting is applied to the colormap, so it has no cost per pixel,
+     * and its resolution is one colormap step
+     * \param mode isotherm mode
+     * \param threshold threshold temperature in °C
+     */
+    void setIsotherm(IsothermMode mode, short threshold)
+    {
+        isothermMode=mode;
+        isothermThreshold=threshold;
+    }
+
+    /**
+     * \param enabled if true, mark the hottest and coldest pixels of the frame
+     * in the (large) rendered image
+     */
+    void setSpotMarkers(bool enabled) { spotMarkers=enabled; }
+
+    /**
+     * Select how the color range follows the scene
+     * \param mode range mode
+     */
+    void setRangeMode(RangeMode mode) { rangeTracker.setMode(mode); }
+
     /**
      * Draw the already rendered image on screen
      * \param dc DrawingContext used to access the screen
@@ -78,29 +142,77 @@ public:
     void legend(mxgui::Color *legend, int legendSize);
 
     /**
-     * \return the minimum temperature of the last rendered frame in °C
+     * \return the minimum temperature of the last rendered frame in °C,
+     * restricted to the visible part when zoomed in. Unlike the color range,
+     * it is not smoothed
      */
     short minTemperature() const { return minTemp; }
 
     /**
-     * \return the maximum temperature of the last rendered frame in °C
+     * \return the maximum temperature of the last rendered frame in °C,
+     * restricted to the visible part when zoomed in. Unlike the color range,
+     * it is not smoothed
      */
     short maxTemperature() const { return maxTemp; }
 
     /**
-     * \return the center point temperature of the last rendered frame in °C
+     * \return the temperature under the crosshair, at the center point of the
+     * last rendered image, in °C
      */
     short crosshairTemperature() const { return crosshairTemp; }
 
+    /**
+     * \return true if in the last rendered frame at least one pixel was above
+     * (IsothermMode::Above) or below (IsothermMode::Below) the isotherm
+     * threshold
+     */
+    bool alarm() const { return alarmFlag; }
+
 private:
     void doRender(MLX90640Frame *processedFrame, bool small);
 
     template<void (ThermalImageRenderer::*putPix)(int x, int y, mxgui::Color c)>
     inline void renderLoop(MLX90640Frame *processedFrame, short range);
 
-    static inline mxgui::Color interpolate2d(MLX90640Frame *processedFrame, int x, int y, short m, short r);
+    template<void (ThermalImageRenderer::*putPix)(int x, int y, mxgui::Color c)>
+    inline void renderZoomLoop(MLX90640Frame *processedFrame, short range);
+
+    void computeWindow();
+
+    void equalizeHistogram(MLX90640Frame *processedFrame, short range);
+
+    void drawSpotMarker(int index, bool hot);
+
+    inline short interpolateZoom(MLX90640Frame *processedFrame, int x, int y);
 
-    static inline mxgui::Color pixMap(short t, short m, short r);
+    inline mxgui::Color interpolate2d(MLX90640Frame *processedFrame, int x, int y, short m, short r);
+
+    /**
+     * \param t temperature, in scaled units
+     * \return true if t is past the isotherm threshold
+     */
+    inline bool pastIsotherm(short t) const
+    {
+        switch(isothermMode)
+        {
+            case IsothermMode::Above: return t>=isothermLevel;
+            case IsothermMode::Below: return t<=isothermLevel;
+            default: return false;
+        }
+    }
+
+    inline mxgui::Color pixMap(short t, short m, short r)
+    {
+        //Compare temperatures rather than colormap indices, as temperatures
+        //outside the color range are clamped to its ends
+        return pastIsotherm(t) ? isothermColor : palette[colormapIndex(t,m,r)];
+    }
+
+    static inline int colormapIndex(short t, short m, short r)
+    {
+        int index=(255*(t-m))/r;
+        return index<0 ? 0 : (index>255 ? 255 : index);
+    }
 
     void crosshairPixel(int x, int y);
 
@@ -129,6 +241,30 @@ private:
         mxgui::Color irImage[94][126];     // Heavy object! ~23KByte
         mxgui::Color irImageSmall[47][63];
     };
-    short minTemp, maxTemp, crosshairTemp;
+    const mxgui::Color *colormap=colormapData(Colormap::Thermal);
+    mxgui::Color equalizedColormap[256]; ///< Colormap remapped by equalization
+    const mxgui::Color *palette;         ///< Colormap used for the last frame
+    /// Halves the distance to a wider scene each frame, narrows back over ~32
+    /// frames, ignores changes up to 1°C. Tuned for the sensor noise at the
+    /// frame rate, so compile-time constants like minRange, not user options
+    RangeTracker rangeTracker{128,8,MLX90640Frame::scaleFactor};
+    short rangeLow, rangeHigh; ///< Color range, in scaled units
+    short minTemp, maxTemp, crosshairTemp; ///< Readouts, in °C
     const short minRange=15;
+    bool equalize=false;
+    bool spotMarkers=false;
+    bool alarmFlag=false;
+    IsothermMode isothermMode=IsothermMode::Off;
+    short isothermThreshold=0;
+    short isothermLevel=0; ///< isothermThreshold in scaled units
+    static const mxgui::Color isothermColor=0x07e0; ///< Green, stands out in all colormaps
+    /// Zoom factor times 2 is 1<<zoomShift, as images are interpolated to
+    /// twice the sensor resolution when not zoomed
+    int zoomShift=1;
+    int panX=MLX90640Frame::nx/2, panY=MLX90640Frame::ny/2;
+    /// Upper left interpolated pixel of the visible image, in units of
+    /// 1/(1<<zoomShift) sensor pixels
+    int originX, originY;
+    /// Sensor pixels contributing to the visible image, bounds included
+    int winX0, winX1, winY0, winY1;
 };
@@ -70,14 +70,24 @@
 #define CFG_TUD_MSC              0
 #define CFG_TUD_HID              0
 #define CFG_TUD_MIDI             0
-#define CFG_TUD_VENDOR           0
-
-// CDC FIFO size of TX and RX
-#define CFG_TUD_CDC_RX_BUFSIZE   (TUD_OPT_HIGH_SPEED ? 512 : 64)
-#define CFG_TUD_CDC_TX_BUFSIZE   (TUD_OPT_HIGH_SPEED ? 512 : 64)
-
-// CDC Endpoint transfer buffer size, more is faster
-#define CFG_TUD_CDC_EP_BUFSIZE   (TUD_OPT_HIGH_SPEED ? 512 : 64)
+#define CFG_TUD_VENDOR           1
+
+// CDC FIFO size of TX and RX. The TX FIFO holds a whole binary frame packet,
+// so a frame is written without waiting for the USB transfers, and the next
+// transfer starts as soon as the previous one completes. The RX FIFO holds a
+// batch of pipelined commands
+#define CFG_TUD_CDC_RX_BUFSIZE   256
+#define CFG_TUD_CDC_TX_BUFSIZE   4096
+
+// CDC Endpoint transfer buffer size, more is faster. Full speed bulk packets
+// are at most 64 bytes, but a transfer can be made of many packets, reducing
+// the per transfer interrupt and tud_task() overhead
+#define CFG_TUD_CDC_EP_BUFSIZE   1024
+
+// Vendor FIFO size of TX and RX. The vendor interface only streams frames to
+// the host, so it gets the same TX FIFO as CDC and a minimal RX one
+#define CFG_TUD_VENDOR_RX_BUFSIZE  64
+#define CFG_TUD_VENDOR_TX_BUFSIZE  4096
 
 #define CFG_TUSB_RHPORT0_MODE (OPT_MODE_DEVICE)
 #define CFG_TUSB_RHPORT1_MODE (OPT_MODE_NONE)